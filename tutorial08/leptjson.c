@@ -2,13 +2,50 @@
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE /* syscall() */
+#endif
 #include "leptjson.h"
 #include <assert.h>  /* assert() */
 #include <errno.h>   /* errno, ERANGE */
+#include <locale.h>  /* localeconv() */
 #include <math.h>    /* HUGE_VAL */
+#include <stdint.h>  /* uint64_t, UINT64_C(), INT64_MAX */
 #include <stdio.h>   /* sprintf() */
 #include <stdlib.h>  /* NULL, malloc(), realloc(), free(), strtod() */
-#include <string.h>  /* memcpy() */
+#include <string.h>  /* memcpy(), strlen() */
+
+#if !defined(LEPT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LEPT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>  /* _BitScanForward() */
+#endif
+#if !defined(LEPT_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#define LEPT_THREADS
+#include <pthread.h> /* pthread_create(), pthread_mutex_lock(), pthread_cond_wait() */
+#endif
+#if !defined(LEPT_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define LEPT_MMAP
+#include <fcntl.h>    /* open() */
+#include <sys/mman.h> /* mmap(), munmap(), posix_madvise() */
+#include <sys/stat.h> /* fstat() */
+#include <unistd.h>   /* close(), pread(), sysconf(), syscall() */
+#endif
+#if !defined(LEPT_NO_URING) && defined(LEPT_MMAP) && defined(__linux__) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h> /* struct io_uring_params, struct io_uring_sqe, IORING_OP_READV */
+#include <sys/syscall.h>    /* __NR_io_uring_setup, __NR_io_uring_enter */
+#include <sys/uio.h>        /* struct iovec */
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define LEPT_URING
+#endif
+#endif
+#endif
 
 #ifndef LEPT_PARSE_STACK_INIT_SIZE
 #define LEPT_PARSE_STACK_INIT_SIZE 256
@@ -18,27 +55,141 @@
 #define LEPT_PARSE_STRINGIFY_INIT_SIZE 256
 #endif
 
+#ifndef LEPT_DOCUMENT_BLOCK_SIZE
+#define LEPT_DOCUMENT_BLOCK_SIZE 4096
+#endif
+
+#ifndef LEPT_DOCUMENT_INTERN
+#define LEPT_DOCUMENT_INTERN 4096 /* default of lept_document.intern */
+#endif
+
+#ifndef LEPT_INTERN_MAX_LENGTH
+#define LEPT_INTERN_MAX_LENGTH 64 /* bytes of a key beyond which it is copied rather than interned */
+#endif
+
+#ifndef LEPT_OBJECT_INDEX_MIN
+#define LEPT_OBJECT_INDEX_MIN 32 /* capacity of objects from which members are looked up through a hash index */
+#endif
+
+#ifndef LEPT_MANY_CHUNK_SIZE
+#define LEPT_MANY_CHUNK_SIZE 65536 /* bytes of newline-delimited JSON a worker takes at once */
+#endif
+
+#ifndef LEPT_SLICE_MIN_SIZE
+#define LEPT_SLICE_MIN_SIZE 65536 /* bytes of a root array below which a slice is not worth a thread */
+#endif
+
+#define LEPT_FLAG_BORROWED  1   /* string characters or object keys are not owned by the value */
+#define LEPT_FLAG_ARENA     2   /* all storage of the value lives in a document arena */
+#define LEPT_FLAG_SCALARS   4   /* no element of the array owns storage, cleared when one is handed out for writing */
+#define LEPT_FLAG_LAZY      8   /* the string, array or object is still text, in u.l, until lept_expand() */
+#define LEPT_FLAG_INLINE    16  /* the string is short enough to be kept in u.c, see LEPT_INLINE_MAX */
+#define LEPT_OWNS_STORAGE(v) ((v)->type == LEPT_STRING || (v)->type == LEPT_ARRAY || (v)->type == LEPT_OBJECT)
+#define LEPT_HOLDS_STORAGE(v) (LEPT_OWNS_STORAGE(v) && !((v)->flags & LEPT_FLAG_INLINE)) /* copying v needs a deep copy */
+#define LEPT_STORAGE(d)     ((d) != NULL ? LEPT_FLAG_ARENA : 0)
+#define LEPT_CHECK_STORAGE(d, v) assert(((v)->flags & LEPT_FLAG_ARENA) ? (d) != NULL : (d) == NULL)
+#define LEPT_INLINE_MAX     (sizeof(((lept_value*)0)->u.c) - 2) /* room for the null character and the length */
+#define LEPT_STRING_CHARS(v) ((v)->flags & LEPT_FLAG_INLINE ? (v)->u.c : (v)->u.s.s)
+#define LEPT_STRING_LENGTH(v) ((v)->flags & LEPT_FLAG_INLINE ? (size_t)(unsigned char)(v)->u.c[LEPT_INLINE_MAX + 1] : (v)->u.s.len)
+#define LEPT_EXPAND(v)      do { if ((v)->flags & LEPT_FLAG_LAZY) lept_expand((lept_value*)(v)); } while(0)
+
+#ifdef LEPT_COMPACT
+struct lept_lazy { const char* json; size_t len; lept_document* d; };
+#define LEPT_LAZY(v)        ((v)->u.l)
+#define LEPT_CAPACITY(p)    ((p) != NULL ? ((const size_t*)(p))[-1] : 0) /* kept before the elements/members */
+#define LEPT_ARRAY_CAPACITY(v)  LEPT_CAPACITY((v)->u.a.e)
+#define LEPT_OBJECT_CAPACITY(v) LEPT_CAPACITY((v)->u.o.m)
+#define LEPT_NEXT_INDEX(node) (((size_t*)((node)->type == LEPT_ARRAY ? (char*)(node) :\
+    (char*)(node) - offsetof(lept_member, v)))[-1]) /* of a container pending release, see lept_release() */
+#define LEPT_SIZE_MAX       ((size_t)UINT32_MAX) /* of counts and lengths, beyond which parsing fails */
+#else
+#define LEPT_LAZY(v)        (&(v)->u.l)
+#define LEPT_ARRAY_CAPACITY(v)  ((v)->u.a.capacity)
+#define LEPT_OBJECT_CAPACITY(v) ((v)->u.o.capacity)
+#define LEPT_NEXT_INDEX(node) ((node)->u.a.capacity)
+#define LEPT_SIZE_MAX       ((size_t)-1)
+#endif
+#define LEPT_GROW(capacity) ((capacity) == 0 ? 1 : (capacity) > LEPT_SIZE_MAX / 2 ? LEPT_SIZE_MAX : (capacity) * 2)
+
 #define EXPECT(c, ch)       do { assert(*c->json == (ch)); c->json++; } while(0)
 #define ISDIGIT(ch)         ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch)     ((ch) >= '1' && (ch) <= '9')
+#define ISWHITESPACE(ch)    ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r')
+#define ISSTRINGSTOP(ch)    ((ch) == '\"' || (ch) == '\\' || (unsigned char)(ch) < 0x20)
+#define PEEK(c, p)          ((p) != (c)->end ? *(p) : '\0')
 #define PUTC(c, ch)         do { *(char*)lept_context_push(c, sizeof(char)) = (ch); } while(0)
 #define PUTS(c, s, len)     memcpy(lept_context_push(c, len), s, len)
 
+/* A node of the trie of JSON Pointers kept by a projection, node 0 being the root. */
+typedef struct {
+    const char* token;  /* unescaped reference token */
+    size_t len;
+    size_t index;       /* the token as an array index, or LEPT_KEY_NOT_EXIST */
+    size_t child, next; /* first child and next sibling, 0 for none */
+    int leaf;           /* some pointer ends here, so all of the value is kept */
+}lept_path;
+
+#define LEPT_SELECT_ALL     ((size_t)-1)    /* the value is kept whole */
+#define LEPT_SELECT_NONE    ((size_t)-2)    /* the value is skipped */
+
 typedef struct {
     const char* json;
+    const char* end;    /* end of input */
+    const char* limit;  /* end of readable memory, past end when the caller provides padding */
+    int insitu;         /* strings are decoded into the (mutable) input and borrowed by the values */
+    int lazy;           /* strings and containers inside the value are left unparsed */
+    lept_document* doc; /* document whose arena holds the parsed values, or NULL for the heap */
+    const lept_path* paths;             /* projection: trie of the JSON Pointers to keep, or NULL to keep all */
+    const lept_allocator* allocator;    /* of the stack */
+    const lept_handler* handler;        /* SAX events, instead of values */
+    size_t max_depth;                   /* of nested containers */
+    void* ctx;                          /* of the handler */
     char* stack;
     size_t size, top;
 }lept_context;
 
+static void* lept_default_alloc(void* user, size_t size) {
+    (void)user;
+    return malloc(size);
+}
+
+static void* lept_default_resize(void* user, void* ptr, size_t old_size, size_t new_size) {
+    (void)user;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void lept_default_dealloc(void* user, void* ptr) {
+    (void)user;
+    free(ptr);
+}
+
+static const lept_allocator lept_default_allocator = { lept_default_alloc, lept_default_resize, lept_default_dealloc, NULL };
+static const lept_allocator* lept_global_allocator = &lept_default_allocator;
+
+#define LEPT_ALLOCATOR(a)               ((a) != NULL ? (a) : lept_global_allocator)
+#define LEPT_ALLOC(a, size)             ((a)->alloc((a)->user, (size)))
+#define LEPT_RESIZE(a, ptr, old, size)  ((a)->resize((a)->user, (ptr), (old), (size)))
+#define LEPT_DEALLOC(a, ptr)            ((a)->dealloc((a)->user, (ptr)))
+
+void lept_set_allocator(const lept_allocator* allocator) {
+    lept_global_allocator = allocator != NULL ? allocator : &lept_default_allocator;
+}
+
+const lept_allocator* lept_get_allocator(void) {
+    return lept_global_allocator;
+}
+
 static void* lept_context_push(lept_context* c, size_t size) {
     void* ret;
     assert(size > 0);
     if (c->top + size >= c->size) {
+        size_t old_size = c->size;
         if (c->size == 0)
             c->size = LEPT_PARSE_STACK_INIT_SIZE;
         while (c->top + size >= c->size)
             c->size += c->size >> 1;  /* c->size * 1.5 */
-        c->stack = (char*)realloc(c->stack, c->size);
+        c->stack = (char*)LEPT_RESIZE(c->allocator, c->stack, old_size, c->size);
     }
     ret = c->stack + c->top;
     c->top += size;
@@ -50,55 +201,408 @@ static void* lept_context_pop(lept_context* c, size_t size) {
     return c->stack + (c->top -= size);
 }
 
-static void lept_parse_whitespace(lept_context* c) {
-    const char *p = c->json;
-    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+struct lept_arena_block {
+    lept_arena_block* next;
+    size_t size;    /* usable bytes following the header */
+};
+
+#define LEPT_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+static void* lept_arena_alloc(lept_document* d, size_t size) {
+    size = LEPT_ARENA_ALIGN(size);
+    if ((size_t)(d->end - d->top) < size) {
+        size_t block_size = d->blocks != NULL ? d->blocks->size * 2 : LEPT_DOCUMENT_BLOCK_SIZE;
+        lept_arena_block* b;
+        while (block_size < size)
+            block_size *= 2;
+        b = (lept_arena_block*)LEPT_ALLOC(LEPT_ALLOCATOR(d->allocator), sizeof(lept_arena_block) + block_size);
+        b->next = d->blocks;
+        b->size = block_size;
+        d->blocks = b;
+        d->top = (char*)(b + 1);
+        d->end = d->top + block_size;
+    }
+    d->last = d->top;
+    d->top += size;
+    return d->last;
+}
+
+/* The newest allocation grows in place, others are copied. */
+static void* lept_arena_realloc(lept_document* d, void* ptr, size_t old_size, size_t new_size) {
+    void* ret;
+    if (ptr != NULL && ptr == d->last && (size_t)(d->end - d->last) >= LEPT_ARENA_ALIGN(new_size)) {
+        d->top = d->last + LEPT_ARENA_ALIGN(new_size);
+        return ptr;
+    }
+    if (new_size <= old_size)
+        return ptr;
+    ret = lept_arena_alloc(d, new_size);
+    if (old_size > 0)
+        memcpy(ret, ptr, old_size);
+    return ret;
+}
+
+/* Values outside of documents use the global allocator, as lept_free() has no other to refer to. */
+static void* lept_malloc(lept_document* d, size_t size) {
+    return d != NULL ? lept_arena_alloc(d, size) : LEPT_ALLOC(lept_global_allocator, size);
+}
+
+static void* lept_realloc(lept_document* d, void* ptr, size_t old_size, size_t new_size) {
+    return d != NULL ? lept_arena_realloc(d, ptr, old_size, new_size) : LEPT_RESIZE(lept_global_allocator, ptr, old_size, new_size);
+}
+
+/* Arena memory is only released with the whole document. */
+static void lept_dealloc(lept_document* d, void* ptr) {
+    if (d == NULL && ptr != NULL)
+        LEPT_DEALLOC(lept_global_allocator, ptr);
+}
+
+/* Resizes the capacity elements or members at ptr from old_size to size bytes, NULL when capacity is 0. */
+static void* lept_store_resize(lept_document* d, void* ptr, size_t capacity, size_t old_size, size_t size) {
+#ifdef LEPT_COMPACT
+    size_t* p = ptr != NULL ? (size_t*)ptr - 1 : NULL;
+    if (capacity == 0) {
+        lept_dealloc(d, p);
+        return NULL;
+    }
+    p = (size_t*)lept_realloc(d, p, p != NULL ? sizeof(size_t) + old_size : 0, sizeof(size_t) + size);
+    *p = capacity;
+    return p + 1;
+#else
+    if (ptr == NULL)
+        return capacity > 0 ? lept_malloc(d, size) : NULL;
+    return lept_realloc(d, ptr, old_size, size);
+#endif
+}
+
+static void lept_store_free(void* ptr) {
+#ifdef LEPT_COMPACT
+    if (ptr != NULL)
+        ptr = (size_t*)ptr - 1;
+#endif
+    lept_dealloc(NULL, ptr);
+}
+
+/* Interned keys live outside of the arena, so that the documents parsed in turn into d share them. */
+struct lept_key {
+    char* k;
+    size_t klen, hash;
+};
+
+/* Takes eight bytes at a time, keys being short. */
+static size_t lept_hash(const char* s, size_t len) {
+    uint64_t h = len, w;
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * UINT64_C(0x9E3779B97F4A7C15);
+    }
+    if (len > 0) {
+        for (w = 0; len > 0; len--)
+            w = w << 8 | (unsigned char)s[len - 1];
+        h = (h ^ w) * UINT64_C(0x9E3779B97F4A7C15);
+    }
+    return (size_t)(h ^ h >> 29);
+}
+
+/* The table is kept at most half full, probing linearly from the hash. */
+static struct lept_key* lept_intern_find(const lept_document* d, const char* key, size_t klen, size_t hash) {
+    size_t i;
+    for (i = hash & d->keys_mask; d->keys[i].k != NULL; i = (i + 1) & d->keys_mask)
+        if (d->keys[i].hash == hash && d->keys[i].klen == klen && memcmp(d->keys[i].k, key, klen) == 0)
+            break;
+    return &d->keys[i];
+}
+
+static void lept_intern_grow(lept_document* d) {
+    struct lept_key* old = d->keys;
+    size_t old_size = old != NULL ? d->keys_mask + 1 : 0, size = old != NULL ? old_size * 2 : 64, i;
+    d->keys = (struct lept_key*)LEPT_ALLOC(LEPT_ALLOCATOR(d->allocator), size * sizeof(struct lept_key));
+    d->keys_mask = size - 1;
+    for (i = 0; i < size; i++)
+        d->keys[i].k = NULL;
+    for (i = 0; i < old_size; i++)
+        if (old[i].k != NULL)
+            memcpy(lept_intern_find(d, old[i].k, old[i].klen, old[i].hash), &old[i], sizeof(struct lept_key));
+    if (old != NULL)
+        LEPT_DEALLOC(LEPT_ALLOCATOR(d->allocator), old);
+}
+
+/* Returns NULL for a key not interned that cannot be. */
+static char* lept_intern_key(lept_document* d, const char* key, size_t klen) {
+    struct lept_key* e;
+    size_t hash;
+    if (klen > LEPT_INTERN_MAX_LENGTH || d->intern == 0)
+        return NULL;
+    if (d->keys == NULL || (d->keys_count < d->intern && (d->keys_count + 1) * 2 > d->keys_mask + 1))
+        lept_intern_grow(d);
+    if ((e = lept_intern_find(d, key, klen, hash = lept_hash(key, klen)))->k == NULL) {
+        if (d->keys_count >= d->intern)
+            return NULL;
+        e->k = (char*)LEPT_ALLOC(LEPT_ALLOCATOR(d->allocator), klen + 1);
+        memcpy(e->k, key, klen);
+        e->k[klen] = '\0';
+        e->klen = klen;
+        e->hash = hash;
+        d->keys_count++;
+    }
+    return e->k;
+}
+
+static char* lept_copy_key(lept_document* d, const char* key, size_t klen) {
+    char* k;
+    if (d != NULL && (k = lept_intern_key(d, key, klen)) != NULL)
+        return k;
+    k = (char*)lept_malloc(d, klen + 1);
+    memcpy(k, key, klen);
+    k[klen] = '\0';
+    return k;
+}
+
+static void lept_set_string_in(lept_document* d, lept_value* v, const char* s, size_t len);
+static void lept_set_array_in(lept_document* d, lept_value* v, size_t capacity);
+static void lept_set_object_in(lept_document* d, lept_value* v, size_t capacity);
+static void lept_index_add(lept_value* v, size_t index);
+static void lept_index_build(lept_value* v);
+static void lept_expand(lept_value* v);
+
+static uint64_t lept_load8(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return (uint64_t)u[0]       | (uint64_t)u[1] <<  8 | (uint64_t)u[2] << 16 | (uint64_t)u[3] << 24 |
+           (uint64_t)u[4] << 32 | (uint64_t)u[5] << 40 | (uint64_t)u[6] << 48 | (uint64_t)u[7] << 56;
+}
+
+static unsigned lept_ctz(unsigned mask) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(mask);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (unsigned)i;
+#else
+    unsigned i;
+    for (i = 0; !(mask & 1); i++)
+        mask >>= 1;
+    return i;
+#endif
+}
+
+#ifndef LEPT_SSE2
+#define LEPT_ONES           ((size_t)-1 / 0xFF)  /* 0x0101...01 */
+#define LEPT_HAS_LESS(x, n) (((x) - LEPT_ONES * (n)) & ~(x) & (LEPT_ONES * 0x80))
+#define LEPT_HAS_BYTE(x, n) LEPT_HAS_LESS((x) ^ (LEPT_ONES * (n)), 1)
+#endif
+
+/* Returns the first byte in [p, end) which ends a run of plain string characters, or end. Blocks may be loaded up to limit. */
+static const char* lept_scan_string(const char* p, const char* end, const char* limit) {
+#ifdef LEPT_SSE2
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+    for (; p < end && limit - p >= 16; p += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)p);
+        __m128i x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, quote), _mm_cmpeq_epi8(s, backslash)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(s, control), control));
+        unsigned mask = (unsigned)_mm_movemask_epi8(x);
+        if (mask != 0)
+            return (p += lept_ctz(mask)) < end ? p : end;
+    }
+#else
+    for (; p < end && (size_t)(limit - p) >= sizeof(size_t); p += sizeof(size_t)) {
+        size_t w;
+        memcpy(&w, p, sizeof(size_t));
+        if (LEPT_HAS_BYTE(w, '\"') | LEPT_HAS_BYTE(w, '\\') | LEPT_HAS_LESS(w, 0x20))
+            break;
+    }
+#endif
+    if (p > end)
+        return end;
+    while (p != end && !ISSTRINGSTOP(*p))
         p++;
-    c->json = p;
+    return p;
+}
+
+/* Returns the first non-whitespace byte in [p, end), or end. Blocks may be loaded up to limit. */
+static const char* lept_scan_whitespace(const char* p, const char* end, const char* limit) {
+#ifdef LEPT_SSE2
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    for (; p < end && limit - p >= 16; p += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)p);
+        __m128i x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, space), _mm_cmpeq_epi8(s, tab)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(s, lf), _mm_cmpeq_epi8(s, cr)));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(x) & 0xFFFF;
+        if (mask != 0)
+            return (p += lept_ctz(mask)) < end ? p : end;
+    }
+    if (p > end)
+        return end;
+#endif
+    while (p != end && ISWHITESPACE(*p))
+        p++;
+    return p;
+}
+
+/* Returns a mask of the bytes of the block at p which are quotation marks, backslashes, control characters or brackets. */
+#ifdef LEPT_SSE2
+#define LEPT_BLOCK_SIZE 16
+static unsigned lept_scan_block(const char* p) {
+    /* setting bit 5 turns '[' and ']' into '{' and '}', and no other byte into either */
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+    const __m128i lower = _mm_set1_epi8(0x20), open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+    __m128i s = _mm_loadu_si128((const __m128i*)p), b = _mm_or_si128(s, lower);
+    __m128i x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, quote), _mm_cmpeq_epi8(s, backslash)),
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(s, control), control),
+                             _mm_or_si128(_mm_cmpeq_epi8(b, open), _mm_cmpeq_epi8(b, close))));
+    return (unsigned)_mm_movemask_epi8(x);
+}
+#else
+#define LEPT_BLOCK_SIZE 8
+#define LEPT_ONES64             UINT64_C(0x0101010101010101)
+#define LEPT_LESS64(x, n)       (((x) - LEPT_ONES64 * (n)) & ~(x) & (LEPT_ONES64 * 0x80))
+#define LEPT_EQUAL64(x, n)      LEPT_LESS64((x) ^ (LEPT_ONES64 * (n)), 1)
+static unsigned lept_scan_block(const char* p) {
+    /* may also flag bytes after a flagged one, the caller checks them all */
+    uint64_t w = lept_load8(p), b = w | LEPT_ONES64 * 0x20;
+    uint64_t x = LEPT_EQUAL64(w, '\"') | LEPT_EQUAL64(w, '\\') | LEPT_LESS64(w, 0x20) | LEPT_EQUAL64(b, '{') | LEPT_EQUAL64(b, '}');
+    return (unsigned)((x >> 7) * UINT64_C(0x0102040810204080) >> 56);  /* the high bit of byte i to bit i */
+}
+#endif
+
+static void lept_parse_whitespace(lept_context* c) {
+    if (c->json != c->end && ISWHITESPACE(*c->json))
+        c->json = lept_scan_whitespace(c->json + 1, c->end, c->limit);
 }
 
 static int lept_parse_literal(lept_context* c, lept_value* v, const char* literal, lept_type type) {
     size_t i;
     EXPECT(c, literal[0]);
     for (i = 0; literal[i + 1]; i++)
-        if (c->json[i] != literal[i + 1])
+        if (c->json + i == c->end || c->json[i] != literal[i + 1])
             return LEPT_PARSE_INVALID_VALUE;
     c->json += i;
     v->type = type;
+    v->flags = 0;
     return LEPT_PARSE_OK;
 }
 
+static int lept_is_eight_digits(uint64_t w) {
+    return ((w & UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+           (((w + UINT64_C(0x0606060606060606)) & UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4)) == UINT64_C(0x3333333333333333);
+}
+
+static uint64_t lept_parse_eight_digits(uint64_t w) {
+    w = (w & UINT64_C(0x0F0F0F0F0F0F0F0F)) * 2561 >> 8;
+    w = (w & UINT64_C(0x00FF00FF00FF00FF)) * 6553601 >> 16;
+    return (w & UINT64_C(0x0000FFFF0000FFFF)) * UINT64_C(42949672960001) >> 32;
+}
+
+/* Consumes a run of digits into *m while it stays below 10^19, counting the digits which did not fit in *dropped. */
+static const char* lept_parse_digits(const char* p, const char* end, uint64_t* m, int* dropped) {
+    for (;;) {
+        if (end - p >= 8 && *m < UINT64_C(100000000000)) {
+            uint64_t w = lept_load8(p);
+            if (lept_is_eight_digits(w)) {
+                *m = *m * 100000000 + lept_parse_eight_digits(w);
+                p += 8;
+                continue;
+            }
+        }
+        if (p == end || !ISDIGIT(*p))
+            return p;
+        if (*m < UINT64_C(1000000000000000000))
+            *m = *m * 10 + (*p - '0');
+        else
+            (*dropped)++;
+        p++;
+    }
+}
+
 static int lept_parse_number(lept_context* c, lept_value* v) {
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
     const char* p = c->json;
-    if (*p == '-') p++;
-    if (*p == '0') p++;
+    const char* q;
+    uint64_t m = 0;
+    int negative = 0, dropped = 0, exp10 = 0, integral = 1;
+    if (PEEK(c, p) == '-') { negative = 1; p++; }
+    if (PEEK(c, p) == '0') p++;
     else {
-        if (!ISDIGIT1TO9(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+        if (!ISDIGIT1TO9(PEEK(c, p))) return LEPT_PARSE_INVALID_VALUE;
+        p = lept_parse_digits(p, c->end, &m, &dropped);
+        exp10 = dropped;
     }
-    if (*p == '.') {
+    if (PEEK(c, p) == '.') {
+        int fdropped = 0;
         p++;
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+        if (!ISDIGIT(PEEK(c, p))) return LEPT_PARSE_INVALID_VALUE;
+        integral = 0;
+        q = lept_parse_digits(p, c->end, &m, &fdropped);
+        exp10 -= (int)(q - p) - fdropped;
+        dropped += fdropped;
+        p = q;
     }
-    if (*p == 'e' || *p == 'E') {
+    if (PEEK(c, p) == 'e' || PEEK(c, p) == 'E') {
+        int e = 0, esign = 1;
+        integral = 0;
         p++;
-        if (*p == '+' || *p == '-') p++;
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
-    }
-    errno = 0;
-    v->u.n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
-        return LEPT_PARSE_NUMBER_TOO_BIG;
+        if (PEEK(c, p) == '+') p++;
+        else if (PEEK(c, p) == '-') { esign = -1; p++; }
+        if (!ISDIGIT(PEEK(c, p))) return LEPT_PARSE_INVALID_VALUE;
+        for (; p != c->end && ISDIGIT(*p); p++)
+            if (e < 100000)
+                e = e * 10 + (*p - '0');
+        exp10 += esign * e;
+    }
+    /* -0 has no integer representation */
+    if (integral && dropped == 0 && (negative ? m - 1 <= (uint64_t)INT64_MAX && m != 0 : m <= (uint64_t)INT64_MAX)) {
+        v->u.i = negative ? -(int64_t)(m - 1) - 1 : (int64_t)m;
+        v->type = LEPT_INTEGER;
+        v->flags = 0;
+        c->json = p;
+        return LEPT_PARSE_OK;
+    }
+#if !defined(__FLT_EVAL_METHOD__) || __FLT_EVAL_METHOD__ == 0
+    /* Exact when both the mantissa and the power of ten are exact doubles: a single rounding (Clinger's fast path). */
+    if (dropped == 0 && m <= (UINT64_C(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+        double d = (double)m;
+        d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+        v->u.n = negative ? -d : d;
+    }
+    else
+#endif
+    if (m == 0)
+        v->u.n = negative ? -0.0 : 0.0;
+    else {
+        /* strtod() works on a copy: the input need not be null-terminated, and its decimal point is the locale's */
+        const char* point = localeconv()->decimal_point;
+        size_t len = p - c->json, plen = strlen(point), i;
+        char* s = (char*)lept_context_push(c, len + plen + 1);
+        for (q = c->json; q != p && *q != '.'; q++)
+            ;
+        memcpy(s, c->json, i = q - c->json);
+        if (q != p) {
+            memcpy(s + i, point, plen);
+            memcpy(s + i + plen, q + 1, len - i - 1);
+            s[len + plen - 1] = '\0';
+        }
+        else
+            s[len] = '\0';
+        lept_context_pop(c, len + plen + 1);
+        errno = 0;
+        v->u.n = strtod(s, NULL);
+        if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
+            return LEPT_PARSE_NUMBER_TOO_BIG;
+    }
     v->type = LEPT_NUMBER;
+    v->flags = 0;
     c->json = p;
     return LEPT_PARSE_OK;
 }
 
-static const char* lept_parse_hex4(const char* p, unsigned* u) {
+static const char* lept_parse_hex4(const char* p, const char* end, unsigned* u) {
     int i;
     *u = 0;
+    if (end - p < 4)
+        return NULL;
     for (i = 0; i < 4; i++) {
         char ch = *p++;
         *u <<= 4;
@@ -110,79 +614,119 @@ static const char* lept_parse_hex4(const char* p, unsigned* u) {
     return p;
 }
 
-static void lept_encode_utf8(lept_context* c, unsigned u) {
+static char* lept_encode_utf8(char* p, unsigned u) {
     if (u <= 0x7F) 
-        PUTC(c, u & 0xFF);
+        *p++ = u & 0xFF;
     else if (u <= 0x7FF) {
-        PUTC(c, 0xC0 | ((u >> 6) & 0xFF));
-        PUTC(c, 0x80 | ( u       & 0x3F));
+        *p++ = 0xC0 | ((u >> 6) & 0xFF);
+        *p++ = 0x80 | ( u       & 0x3F);
     }
     else if (u <= 0xFFFF) {
-        PUTC(c, 0xE0 | ((u >> 12) & 0xFF));
-        PUTC(c, 0x80 | ((u >>  6) & 0x3F));
-        PUTC(c, 0x80 | ( u        & 0x3F));
+        *p++ = 0xE0 | ((u >> 12) & 0xFF);
+        *p++ = 0x80 | ((u >>  6) & 0x3F);
+        *p++ = 0x80 | ( u        & 0x3F);
     }
     else {
         assert(u <= 0x10FFFF);
-        PUTC(c, 0xF0 | ((u >> 18) & 0xFF));
-        PUTC(c, 0x80 | ((u >> 12) & 0x3F));
-        PUTC(c, 0x80 | ((u >>  6) & 0x3F));
-        PUTC(c, 0x80 | ( u        & 0x3F));
+        *p++ = 0xF0 | ((u >> 18) & 0xFF);
+        *p++ = 0x80 | ((u >> 12) & 0x3F);
+        *p++ = 0x80 | ((u >>  6) & 0x3F);
+        *p++ = 0x80 | ( u        & 0x3F);
     }
+    return p;
 }
 
 #define STRING_ERROR(ret) do { c->top = head; return ret; } while(0)
+#define STRING_PUTC(ch)   do { if (out) *out++ = (ch); else PUTC(c, ch); } while(0)
+
+/* In-situ, the string is decoded over its own escaped form, which is never shorter. */
 
 static int lept_parse_string_raw(lept_context* c, char** str, size_t* len) {
     size_t head = c->top;
     unsigned u, u2;
     const char* p;
+    char* out = NULL;
     EXPECT(c, '\"');
     p = c->json;
+    if (c->insitu)
+        out = *str = (char*)p;
+    else {
+        /* without escapes the string is used where it stands, the caller only reads it */
+        const char* q = lept_scan_string(p, c->end, c->limit);
+        if (q != c->end && *q == '\"') {
+            *str = (char*)p;
+            *len = q - p;
+            c->json = q + 1;
+            return LEPT_PARSE_OK;
+        }
+    }
     for (;;) {
-        char ch = *p++;
+        const char* q = lept_scan_string(p, c->end, c->limit);
+        char ch;
+        if (q != p) {
+            if (!out)
+                PUTS(c, p, q - p);
+            else {
+                if (out != p)
+                    memmove(out, p, q - p);
+                out += q - p;
+            }
+            p = q;
+        }
+        if (p == c->end)
+            STRING_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK);
+        ch = *p++;
         switch (ch) {
             case '\"':
-                *len = c->top - head;
-                *str = lept_context_pop(c, *len);
+                if (out) {
+                    *len = out - *str;
+                    *out = '\0';
+                }
+                else {
+                    *len = c->top - head;
+                    *str = lept_context_pop(c, *len);
+                }
                 c->json = p;
                 return LEPT_PARSE_OK;
             case '\\':
-                switch (*p++) {
-                    case '\"': PUTC(c, '\"'); break;
-                    case '\\': PUTC(c, '\\'); break;
-                    case '/':  PUTC(c, '/' ); break;
-                    case 'b':  PUTC(c, '\b'); break;
-                    case 'f':  PUTC(c, '\f'); break;
-                    case 'n':  PUTC(c, '\n'); break;
-                    case 'r':  PUTC(c, '\r'); break;
-                    case 't':  PUTC(c, '\t'); break;
+                switch (p != c->end ? *p++ : '\0') {
+                    case '\"': STRING_PUTC('\"'); break;
+                    case '\\': STRING_PUTC('\\'); break;
+                    case '/':  STRING_PUTC('/' ); break;
+                    case 'b':  STRING_PUTC('\b'); break;
+                    case 'f':  STRING_PUTC('\f'); break;
+                    case 'n':  STRING_PUTC('\n'); break;
+                    case 'r':  STRING_PUTC('\r'); break;
+                    case 't':  STRING_PUTC('\t'); break;
                     case 'u':
-                        if (!(p = lept_parse_hex4(p, &u)))
+                        if (!(p = lept_parse_hex4(p, c->end, &u)))
                             STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
                         if (u >= 0xD800 && u <= 0xDBFF) { /* surrogate pair */
-                            if (*p++ != '\\')
+                            if (p == c->end || *p++ != '\\')
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
-                            if (*p++ != 'u')
+                            if (p == c->end || *p++ != 'u')
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
-                            if (!(p = lept_parse_hex4(p, &u2)))
+                            if (!(p = lept_parse_hex4(p, c->end, &u2)))
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
                             if (u2 < 0xDC00 || u2 > 0xDFFF)
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
                             u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
                         }
-                        lept_encode_utf8(c, u);
+                        if (out)
+                            out = lept_encode_utf8(out, u);
+                        else {
+                            char* s = lept_context_push(c, 4);
+                            c->top -= 4 - (lept_encode_utf8(s, u) - s);
+                        }
                         break;
                     default:
                         STRING_ERROR(LEPT_PARSE_INVALID_STRING_ESCAPE);
                 }
                 break;
-            case '\0':
-                STRING_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK);
             default:
                 if ((unsigned char)ch < 0x20)
                     STRING_ERROR(LEPT_PARSE_INVALID_STRING_CHAR);
-                PUTC(c, ch);
+                STRING_PUTC(ch);
         }
     }
 }
@@ -191,155 +735,2320 @@ static int lept_parse_string(lept_context* c, lept_value* v) {
     int ret;
     char* s;
     size_t len;
-    if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK)
-        lept_set_string(v, s, len);
+    if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK) {
+        if (len > LEPT_SIZE_MAX)
+            return LEPT_PARSE_SIZE_EXCEEDED;
+        if (c->insitu) {
+            v->u.s.s = s;
+            v->u.s.len = len;
+            v->type = LEPT_STRING;
+            v->flags = LEPT_FLAG_BORROWED;
+        }
+        else
+            lept_set_string_in(c->doc, v, s, len);
+    }
     return ret;
 }
 
-static int lept_parse_value(lept_context* c, lept_value* v);
+/* SAX mode hands out events instead of building values. */
+
+static int lept_sax_scalar(lept_context* c, const lept_value* v) {
+    const lept_handler* h = c->handler;
+    int ok = 1;
+    switch (v->type) {
+        case LEPT_NULL:    if (h->null) ok = h->null(c->ctx); break;
+        case LEPT_FALSE:   if (h->boolean) ok = h->boolean(c->ctx, 0); break;
+        case LEPT_TRUE:    if (h->boolean) ok = h->boolean(c->ctx, 1); break;
+        case LEPT_NUMBER:  if (h->number) ok = h->number(c->ctx, v->u.n); break;
+        case LEPT_INTEGER:
+            if (h->integer)
+                ok = h->integer(c->ctx, v->u.i);
+            else if (h->number)
+                ok = h->number(c->ctx, (double)v->u.i);
+            break;
+        default: assert(0 && "invalid type");
+    }
+    return ok ? LEPT_PARSE_OK : LEPT_PARSE_ABORTED;
+}
+
+static int lept_sax_end(lept_context* c, int (*end)(void* ctx, size_t count), size_t count) {
+    return end == NULL || end(c->ctx, count) ? LEPT_PARSE_OK : LEPT_PARSE_ABORTED;
+}
+
+/* Containers are parsed without recursion: each open one has a frame on the context stack, followed
+ * by its elements or members when building values. */
+
+typedef struct {
+    size_t parent;  /* offset of the enclosing frame */
+    size_t count;   /* elements, or members including one waiting for its value */
+    size_t select;  /* path node of the container, or LEPT_SELECT_ALL */
+    size_t index;   /* of the element being parsed */
+    char type;      /* '[' or '{' */
+    char owning;    /* some element owns storage */
+}lept_frame;
+
+#define LEPT_FRAME(c, frame) ((lept_frame*)((c)->stack + (frame)))
+
+static int lept_parse_scalar(lept_context* c, lept_value* v) {
+    char* s;
+    size_t len;
+    int ret;
+    if (c->json == c->end)
+        return LEPT_PARSE_EXPECT_VALUE;
+    lept_init(v);
+    switch (*c->json) {
+        case 't':  ret = lept_parse_literal(c, v, "true", LEPT_TRUE); break;
+        case 'f':  ret = lept_parse_literal(c, v, "false", LEPT_FALSE); break;
+        case 'n':  ret = lept_parse_literal(c, v, "null", LEPT_NULL); break;
+        default:   ret = lept_parse_number(c, v); break;
+        case '"':
+            if (c->handler == NULL)
+                return lept_parse_string(c, v);
+            if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK && c->handler->string && !c->handler->string(c->ctx, s, len))
+                ret = LEPT_PARSE_ABORTED;
+            return ret;
+    }
+    return ret == LEPT_PARSE_OK && c->handler != NULL ? lept_sax_scalar(c, v) : ret;
+}
+
+/* Returns how to parse the member key, or else the element index, of a value selected by node. */
+static size_t lept_select(const lept_context* c, size_t node, const char* key, size_t klen, size_t index) {
+    size_t i;
+    if (node == LEPT_SELECT_ALL)
+        return LEPT_SELECT_ALL;
+    for (i = c->paths[node].child; i != 0; i = c->paths[i].next)
+        if (key != NULL ? c->paths[i].len == klen && memcmp(c->paths[i].token, key, klen) == 0 : c->paths[i].index == index)
+            return c->paths[i].leaf ? LEPT_SELECT_ALL : i;
+    return LEPT_SELECT_NONE;
+}
+
+static int lept_parse_open(lept_context* c, size_t* frame, size_t* depth, size_t select) {
+    lept_frame f;
+    f.type = *c->json;
+    if (*depth == c->max_depth)
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    if (c->handler != NULL) {
+        int (*start)(void* ctx) = f.type == '[' ? c->handler->start_array : c->handler->start_object;
+        if (start != NULL && !start(c->ctx))
+            return LEPT_PARSE_ABORTED;
+    }
+    c->json++;
+    f.parent = *frame;
+    f.count = 0;
+    f.select = select;
+    f.index = 0;
+    f.owning = 0;
+    *frame = c->top;
+    memcpy(lept_context_push(c, sizeof(lept_frame)), &f, sizeof(lept_frame));
+    (*depth)++;
+    return LEPT_PARSE_OK;
+}
 
-static int lept_parse_array(lept_context* c, lept_value* v) {
-    size_t i, size = 0;
+/*
+ * Parses the key of a member, its colon and the whitespace around, the member then waits on the stack for its value.
+ * *select tells how to parse the value, a skipped member is not kept.
+ */
+static int lept_parse_key(lept_context* c, size_t frame, size_t* select) {
+    lept_member m;
+    char* str;
     int ret;
-    EXPECT(c, '[');
+    if (PEEK(c, c->json) != '"')
+        return LEPT_PARSE_MISS_KEY;
+    if ((ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK)
+        return ret;
+    if ((*select = lept_select(c, LEPT_FRAME(c, frame)->select, str, m.klen, 0)) != LEPT_SELECT_NONE) {
+        if (c->handler != NULL) {
+            if (c->handler->key && !c->handler->key(c->ctx, str, m.klen))
+                return LEPT_PARSE_ABORTED;
+        }
+        else {
+            if (c->insitu)
+                m.k = str;
+            else
+                m.k = lept_copy_key(c->doc, str, m.klen);
+            lept_init(&m.v);
+            memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
+        }
+        LEPT_FRAME(c, frame)->count++;
+    }
     lept_parse_whitespace(c);
-    if (*c->json == ']') {
-        c->json++;
-        lept_set_array(v, 0);
-        return LEPT_PARSE_OK;
+    if (PEEK(c, c->json) != ':')
+        return LEPT_PARSE_MISS_COLON;
+    c->json++;
+    lept_parse_whitespace(c);
+    return LEPT_PARSE_OK;
+}
+
+/* Adds the complete value v to the innermost open container, after nulls in place of skipped elements. */
+static void lept_parse_add(lept_context* c, size_t frame, lept_value* v) {
+    lept_value* e;
+    if (LEPT_FRAME(c, frame)->type == '[') {
+        for (; LEPT_FRAME(c, frame)->count < LEPT_FRAME(c, frame)->index; LEPT_FRAME(c, frame)->count++) {
+            e = (lept_value*)lept_context_push(c, sizeof(lept_value));
+            lept_init(e);
+        }
+        if (c->handler == NULL)
+            memcpy(lept_context_push(c, sizeof(lept_value)), v, sizeof(lept_value));
+        LEPT_FRAME(c, frame)->count++;
+        LEPT_FRAME(c, frame)->owning |= LEPT_HOLDS_STORAGE(v);
     }
-    for (;;) {
-        lept_value e;
-        lept_init(&e);
-        if ((ret = lept_parse_value(c, &e)) != LEPT_PARSE_OK)
+    else if (c->handler == NULL)
+        memcpy(&((lept_member*)(c->stack + c->top - sizeof(lept_member)))->v, v, sizeof(lept_value));
+}
+
+/* Ends the innermost open container, moving its elements or members into v. */
+static int lept_parse_close(lept_context* c, lept_value* v, size_t* frame, size_t* depth) {
+    lept_frame f;
+    int ret = LEPT_PARSE_OK;
+    memcpy(&f, LEPT_FRAME(c, *frame), sizeof(lept_frame));
+    if (c->handler == NULL && f.count > LEPT_SIZE_MAX)
+        return LEPT_PARSE_SIZE_EXCEEDED;
+    c->json++;
+    if (c->handler != NULL)
+        ret = lept_sax_end(c, f.type == '[' ? c->handler->end_array : c->handler->end_object, f.count);
+    else if (f.type == '[') {
+        lept_init(v);
+        lept_set_array_in(c->doc, v, f.count);
+        if (f.count > 0)
+            memcpy(v->u.a.e, lept_context_pop(c, f.count * sizeof(lept_value)), f.count * sizeof(lept_value));
+        v->u.a.size = f.count;
+        if (!f.owning)
+            v->flags |= LEPT_FLAG_SCALARS;
+    }
+    else {
+        lept_init(v);
+        lept_set_object_in(c->doc, v, f.count);
+        if (f.count > 0)
+            memcpy(v->u.o.m, lept_context_pop(c, f.count * sizeof(lept_member)), f.count * sizeof(lept_member));
+        v->u.o.size = f.count;
+        lept_index_build(v);
+        if (c->insitu)
+            v->flags |= LEPT_FLAG_BORROWED;
+    }
+    lept_context_pop(c, sizeof(lept_frame));
+    *frame = f.parent;
+    (*depth)--;
+    return ret;
+}
+
+/* Pops and frees the open containers after an error. */
+static void lept_context_unwind(lept_context* c, size_t frame, size_t depth) {
+    lept_frame f;
+    size_t i;
+    for (; depth > 0; depth--) {
+        memcpy(&f, LEPT_FRAME(c, frame), sizeof(lept_frame));
+        for (i = 0; i < f.count && c->handler == NULL; i++) {
+            if (f.type == '[')
+                lept_free((lept_value*)lept_context_pop(c, sizeof(lept_value)));
+            else {
+                lept_member* m = (lept_member*)lept_context_pop(c, sizeof(lept_member));
+                if (!c->insitu)
+                    lept_dealloc(c->doc, m->k);
+                lept_free(&m->v);
+            }
+        }
+        lept_context_pop(c, sizeof(lept_frame));
+        frame = f.parent;
+    }
+}
+
+/*
+ * Skips the string, array or object at c->json, only checking that strings end and brackets match. Blocks of input
+ * are scanned at once for the bytes which may change the state, and bytes after backslashes in strings are ignored.
+ */
+static int lept_skip(lept_context* c) {
+    size_t head = c->top, n;
+    const char* p = c->json, *q, *escaped = NULL, *stop = NULL;
+    unsigned mask;
+    int string = 0, ret = LEPT_PARSE_OK;
+    while (stop == NULL && ret == LEPT_PARSE_OK) {
+        if (p >= c->end) {
+            if (string)
+                ret = LEPT_PARSE_MISS_QUOTATION_MARK;
+            else
+                ret = c->stack[c->top - 1] == '[' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
             break;
-        memcpy(lept_context_push(c, sizeof(lept_value)), &e, sizeof(lept_value));
-        size++;
-        lept_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json++;
-            lept_parse_whitespace(c);
         }
-        else if (*c->json == ']') {
-            c->json++;
-            lept_set_array(v, size);
-            memcpy(v->u.a.e, lept_context_pop(c, size * sizeof(lept_value)), size * sizeof(lept_value));
-            v->u.a.size = size;
-            return LEPT_PARSE_OK;
+        if ((size_t)(c->limit - p) >= LEPT_BLOCK_SIZE) {
+            n = LEPT_BLOCK_SIZE;
+            mask = lept_scan_block(p);
+            if ((size_t)(c->end - p) < n)
+                mask &= (1u << (c->end - p)) - 1;
         }
         else {
-            ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-            break;
+            n = 1;
+            mask = 1;
+        }
+        for (; mask != 0 && stop == NULL && ret == LEPT_PARSE_OK; mask &= mask - 1) {
+            if ((q = p + lept_ctz(mask)) == escaped)
+                continue;
+            if (string) {
+                if (*q == '\\')
+                    escaped = q + 1;
+                else if (*q == '\"')
+                    string = 0;
+                else if ((unsigned char)*q < 0x20)
+                    ret = LEPT_PARSE_INVALID_STRING_CHAR;
+            }
+            else switch (*q) {
+                case '"':
+                    string = 1;
+                    break;
+                case '[':
+                case '{':
+                    if (c->top - head == c->max_depth)
+                        ret = LEPT_PARSE_DEPTH_EXCEEDED;
+                    else
+                        PUTC(c, *q);
+                    break;
+                case ']':
+                    if (c->stack[--c->top] != '[')
+                        ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    break;
+                case '}':
+                    if (c->stack[--c->top] != '{')
+                        ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    break;
+                default:
+                    continue;
+            }
+            if (!string && c->top == head)
+                stop = q + 1;
         }
+        p += n;
     }
-    /* Pop and free values on the stack */
-    for (i = 0; i < size; i++)
-        lept_free((lept_value*)lept_context_pop(c, sizeof(lept_value)));
+    c->top = head;
+    if (ret == LEPT_PARSE_OK)
+        c->json = stop;
     return ret;
 }
 
-static int lept_parse_object(lept_context* c, lept_value* v) {
-    size_t i, size;
-    lept_member m;
+/* Lazy parsing records the text of strings and containers, which are only skipped. */
+static int lept_parse_lazy(lept_context* c, lept_value* v) {
+    const char* json = c->json;
+    char ch = PEEK(c, json);
     int ret;
-    EXPECT(c, '{');
-    lept_parse_whitespace(c);
-    if (*c->json == '}') {
-        c->json++;
-        lept_set_object(v, 0);
-        return LEPT_PARSE_OK;
-    }
-    m.k = NULL;
-    size = 0;
+    if (ch != '"' && ch != '[' && ch != '{')
+        return lept_parse_scalar(c, v);
+    assert(c->doc != NULL);
+    if ((ret = lept_skip(c)) != LEPT_PARSE_OK)
+        return ret;
+    v->type = ch == '"' ? LEPT_STRING : ch == '[' ? LEPT_ARRAY : LEPT_OBJECT;
+    v->flags = LEPT_FLAG_ARENA | LEPT_FLAG_LAZY;
+#ifdef LEPT_COMPACT
+    v->u.l = (struct lept_lazy*)lept_malloc(c->doc, sizeof(struct lept_lazy));
+#endif
+    LEPT_LAZY(v)->json = json;
+    LEPT_LAZY(v)->len = c->json - json;
+    LEPT_LAZY(v)->d = c->doc;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_parse_value(lept_context* c, lept_value* v);
+
+/* Parses a value the projection does not keep with the grammar checks of any other, but without building it. */
+static int lept_parse_unselected(lept_context* c, size_t depth) {
+    static const lept_handler none;
+    const lept_handler* handler = c->handler;
+    const lept_path* paths = c->paths;
+    size_t max_depth = c->max_depth;
+    int ret, lazy = c->lazy;
+    c->handler = &none;
+    c->paths = NULL;
+    c->max_depth -= depth;
+    c->lazy = 0;
+    ret = lept_parse_value(c, NULL);
+    c->handler = handler;
+    c->paths = paths;
+    c->max_depth = max_depth;
+    c->lazy = lazy;
+    return ret;
+}
+
+/* v is only set when building values. */
+static int lept_parse_value(lept_context* c, lept_value* v) {
+    lept_value e;
+    lept_frame* f;
+    size_t frame = 0, depth = 0, select = c->paths == NULL || c->paths[0].leaf ? LEPT_SELECT_ALL : 0;
+    int ret, closing, keep;
+    char ch;
+    lept_init(&e);
     for (;;) {
-        char* str;
-        lept_init(&m.v);
-        /* parse key */
-        if (*c->json != '"') {
-            ret = LEPT_PARSE_MISS_KEY;
-            break;
+        /* a value, or containers opening until one */
+        ch = PEEK(c, c->json);
+        closing = 0;
+        keep = 1;
+        if (c->lazy && depth > 0) {
+            if ((ret = lept_parse_lazy(c, &e)) != LEPT_PARSE_OK)
+                break;
         }
-        if ((ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK)
-            break;
-        memcpy(m.k = (char*)malloc(m.klen + 1), str, m.klen);
-        m.k[m.klen] = '\0';
-        /* parse ws colon ws */
-        lept_parse_whitespace(c);
-        if (*c->json != ':') {
-            ret = LEPT_PARSE_MISS_COLON;
-            break;
+        else if (select != LEPT_SELECT_ALL && (select == LEPT_SELECT_NONE || (ch != '[' && ch != '{'))) {
+            /* neither kept by the projection nor on the way to a kept value */
+            if ((ret = lept_parse_unselected(c, depth)) != LEPT_PARSE_OK)
+                break;
+            if (select != LEPT_SELECT_NONE && depth > 0 && LEPT_FRAME(c, frame)->type == '{') {
+                /* the member was kept for a pointer leading through it */
+                lept_dealloc(c->doc, ((lept_member*)lept_context_pop(c, sizeof(lept_member)))->k);
+                LEPT_FRAME(c, frame)->count--;
+            }
+            keep = 0;
         }
-        c->json++;
-        lept_parse_whitespace(c);
-        /* parse value */
-        if ((ret = lept_parse_value(c, &m.v)) != LEPT_PARSE_OK)
-            break;
-        memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
-        size++;
-        m.k = NULL; /* ownership is transferred to member on stack */
-        /* parse ws [comma | right-curly-brace] ws */
-        lept_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json++;
+        else if (ch == '[' || ch == '{') {
+            if ((ret = lept_parse_open(c, &frame, &depth, select)) != LEPT_PARSE_OK)
+                break;
             lept_parse_whitespace(c);
+            if (PEEK(c, c->json) == (ch == '[' ? ']' : '}'))
+                closing = 1;
+            else if (ch == '[') {
+                select = lept_select(c, LEPT_FRAME(c, frame)->select, NULL, 0, 0);
+                continue;
+            }
+            else if ((ret = lept_parse_key(c, frame, &select)) == LEPT_PARSE_OK)
+                continue;
+            else
+                break;
         }
-        else if (*c->json == '}') {
-            c->json++;
-            lept_set_object(v, size);
-            memcpy(v->u.o.m, lept_context_pop(c, sizeof(lept_member) * size), sizeof(lept_member) * size);
-            v->u.o.size = size;
-            return LEPT_PARSE_OK;
-        }
-        else {
-            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        else if ((ret = lept_parse_scalar(c, &e)) != LEPT_PARSE_OK)
             break;
+        /* e is complete, or the innermost container ends */
+        for (;;) {
+            if (!closing) {
+                if (depth == 0) {
+                    if (c->handler == NULL && keep)
+                        memcpy(v, &e, sizeof(lept_value));
+                    return LEPT_PARSE_OK;
+                }
+                if (keep)
+                    lept_parse_add(c, frame, &e);
+                lept_parse_whitespace(c);
+                ch = LEPT_FRAME(c, frame)->type;
+                if (PEEK(c, c->json) == ',') {
+                    c->json++;
+                    lept_parse_whitespace(c);
+                    if (ch == '{')
+                        ret = lept_parse_key(c, frame, &select);
+                    else {
+                        f = LEPT_FRAME(c, frame);
+                        select = lept_select(c, f->select, NULL, 0, ++f->index);
+                    }
+                    break;
+                }
+                if (PEEK(c, c->json) != (ch == '[' ? ']' : '}')) {
+                    ret = ch == '[' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    break;
+                }
+            }
+            if ((ret = lept_parse_close(c, &e, &frame, &depth)) != LEPT_PARSE_OK)
+                break;
+            closing = 0;
+            keep = 1;
         }
+        if (ret != LEPT_PARSE_OK)
+            break;
     }
-    /* Pop and free members on the stack */
-    free(m.k);
-    for (i = 0; i < size; i++) {
-        lept_member* m = (lept_member*)lept_context_pop(c, sizeof(lept_member));
-        free(m->k);
-        lept_free(&m->v);
-    }
-    v->type = LEPT_NULL;
+    lept_context_unwind(c, frame, depth);
     return ret;
 }
 
-static int lept_parse_value(lept_context* c, lept_value* v) {
-    switch (*c->json) {
-        case 't':  return lept_parse_literal(c, v, "true", LEPT_TRUE);
-        case 'f':  return lept_parse_literal(c, v, "false", LEPT_FALSE);
-        case 'n':  return lept_parse_literal(c, v, "null", LEPT_NULL);
-        default:   return lept_parse_number(c, v);
-        case '"':  return lept_parse_string(c, v);
-        case '[':  return lept_parse_array(c, v);
-        case '{':  return lept_parse_object(c, v);
-        case '\0': return LEPT_PARSE_EXPECT_VALUE;
-    }
+/* Takes over the scratch stack of parser, if any, shrinking it first when the previous call grew it beyond parser->trim. */
+static void lept_context_acquire(lept_context* c, lept_parser* parser) {
+    c->top = 0;
+    c->max_depth = parser != NULL && parser->max_depth > 0 ? parser->max_depth : LEPT_PARSE_MAX_DEPTH;
+    if (parser == NULL) {
+        c->allocator = lept_global_allocator;
+        c->stack = NULL;
+        c->size = 0;
+        return;
+    }
+    c->allocator = LEPT_ALLOCATOR(parser->allocator);
+    if (parser->trim > 0 && parser->size > parser->trim) {
+        parser->stack = (char*)LEPT_RESIZE(c->allocator, parser->stack, parser->size, parser->trim);
+        parser->size = parser->trim;
+    }
+    c->stack = parser->stack;
+    c->size = parser->size;
+}
+
+static void lept_context_release(lept_context* c, lept_parser* parser) {
+    if (parser == NULL) {
+        if (c->stack != NULL)
+            LEPT_DEALLOC(c->allocator, c->stack);
+    }
+    else {
+        parser->stack = c->stack;
+        parser->size = c->size;
+    }
+}
+
+static void lept_context_init(lept_context* c, const char* json, size_t len, size_t padding) {
+    assert(json != NULL || len == 0);
+    c->json = json;
+    c->end = json + len;
+    c->limit = c->end + padding;
+    c->insitu = 0;
+    c->lazy = 0;
+    c->doc = NULL;
+    c->paths = NULL;
+    c->handler = NULL;
+}
+
+/* Parses the whole input of c into v, a lazy value when c->lazy. */
+static int lept_parse_root(lept_context* c, lept_parser* parser, lept_value* v) {
+    int ret;
+    assert(v != NULL);
+    lept_context_acquire(c, parser);
+    lept_init(v);
+    lept_parse_whitespace(c);
+    if ((ret = c->lazy ? lept_parse_lazy(c, v) : lept_parse_value(c, v)) == LEPT_PARSE_OK) {
+        lept_parse_whitespace(c);
+        if (c->json != c->end) {
+            lept_free(v);
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+        }
+    }
+    assert(c->top == 0);
+    lept_context_release(c, parser);
+    return ret;
+}
+
+static int lept_parse_buffer(lept_parser* parser, lept_document* doc, lept_value* v, const char* json, size_t len, size_t padding, int insitu, int lazy) {
+    lept_context c;
+    lept_context_init(&c, json, len, padding);
+    c.insitu = insitu;
+    c.lazy = lazy;
+    c.doc = doc;
+    return lept_parse_root(&c, parser, v);
+}
+
+int lept_parse(lept_value* v, const char* json) {
+    assert(json != NULL);
+    return lept_parse_buffer(NULL, NULL, v, json, strlen(json), 0, 0, 0);
+}
+
+int lept_parse_n(lept_value* v, const char* json, size_t len) {
+    return lept_parse_buffer(NULL, NULL, v, json, len, 0, 0, 0);
+}
+
+int lept_parse_padded(lept_value* v, const char* json, size_t len) {
+    return lept_parse_buffer(NULL, NULL, v, json, len, LEPT_PARSE_PADDING, 0, 0);
+}
+
+int lept_parse_insitu(lept_value* v, char* json, size_t len) {
+    return lept_parse_buffer(NULL, NULL, v, json, len, 0, 1, 0);
+}
+
+/* Builds the trie of JSON Pointers in a single block, the unescaped tokens following the nodes. */
+static lept_path* lept_paths_build(const char* const* paths, size_t n) {
+    size_t i, j, count = 1, size = 0, used = 1, node, len;
+    const char* p;
+    char* out, *token;
+    lept_path* t;
+    for (i = 0; i < n; i++) {
+        assert(paths[i] != NULL && (paths[i][0] == '/' || paths[i][0] == '\0'));
+        for (p = paths[i]; *p != '\0'; p++, size++)
+            if (*p == '/')
+                count++;
+    }
+    t = (lept_path*)LEPT_ALLOC(lept_global_allocator, count * sizeof(lept_path) + size);
+    out = (char*)(t + count);
+    t[0].child = t[0].next = 0;
+    t[0].leaf = 0;
+    for (i = 0; i < n; i++) {
+        node = 0;
+        for (p = paths[i]; *p == '/'; ) {
+            for (token = out, p++; *p != '\0' && *p != '/'; p++) {
+                if (*p == '~' && (p[1] == '0' || p[1] == '1'))
+                    *out++ = *++p == '0' ? '~' : '/';
+                else
+                    *out++ = *p;
+            }
+            len = out - token;
+            for (j = t[node].child; j != 0; j = t[j].next)
+                if (t[j].len == len && memcmp(t[j].token, token, len) == 0)
+                    break;
+            if (j != 0)
+                out = token;
+            else {
+                j = used++;
+                t[j].token = token;
+                t[j].len = len;
+                /* array indices are decimal without leading zeros */
+                t[j].index = len > 0 && len < 19 && (token[0] != '0' || len == 1) ? 0 : LEPT_KEY_NOT_EXIST;
+                for (len = 0; len < t[j].len && t[j].index != LEPT_KEY_NOT_EXIST; len++)
+                    t[j].index = ISDIGIT(token[len]) ? t[j].index * 10 + (token[len] - '0') : LEPT_KEY_NOT_EXIST;
+                t[j].child = 0;
+                t[j].leaf = 0;
+                t[j].next = t[node].child;
+                t[node].child = j;
+            }
+            node = j;
+        }
+        t[node].leaf = 1;
+    }
+    return t;
+}
+
+int lept_parse_projection(lept_value* v, const char* json, size_t len, const char* const* paths, size_t n) {
+    lept_context c;
+    lept_path* trie;
+    int ret;
+    assert(paths != NULL || n == 0);
+    lept_context_init(&c, json, len, 0);
+    c.paths = trie = lept_paths_build(paths, n);
+    ret = lept_parse_root(&c, NULL, v);
+    LEPT_DEALLOC(lept_global_allocator, trie);
+    return ret;
+}
+
+int lept_skip_value(const char* json, size_t len, size_t* end) {
+    lept_context c;
+    lept_value v;
+    char ch;
+    int ret;
+    lept_context_init(&c, json, len, 0);
+    lept_context_acquire(&c, NULL);
+    lept_parse_whitespace(&c);
+    ch = PEEK(&c, c.json);
+    ret = ch == '"' || ch == '[' || ch == '{' ? lept_skip(&c) : lept_parse_scalar(&c, &v);
+    lept_context_release(&c, NULL);
+    if (ret == LEPT_PARSE_OK && end != NULL)
+        *end = c.json - json;
+    return ret;
+}
+
+static int lept_parse_sax_buffer(lept_parser* parser, const char* json, size_t len, size_t padding, const lept_handler* handler, void* ctx) {
+    lept_context c;
+    int ret;
+    assert(handler != NULL);
+    lept_context_init(&c, json, len, padding);
+    c.handler = handler;
+    c.ctx = ctx;
+    lept_context_acquire(&c, parser);
+    lept_parse_whitespace(&c);
+    if ((ret = lept_parse_value(&c, NULL)) == LEPT_PARSE_OK) {
+        lept_parse_whitespace(&c);
+        if (c.json != c.end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    c.top = 0;
+    lept_context_release(&c, parser);
+    return ret;
+}
+
+int lept_parse_sax(const char* json, size_t len, const lept_handler* handler, void* ctx) {
+    return lept_parse_sax_buffer(NULL, json, len, 0, handler, ctx);
+}
+
+void lept_parser_init(lept_parser* parser) {
+    assert(parser != NULL);
+    parser->stack = NULL;
+    parser->size = parser->trim = parser->padding = parser->max_depth = 0;
+    parser->allocator = NULL;
+}
+
+/* Keeps the allocator for reuse. */
+void lept_parser_free(lept_parser* parser) {
+    const lept_allocator* allocator;
+    assert(parser != NULL);
+    allocator = parser->allocator;
+    if (parser->stack != NULL)
+        LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), parser->stack);
+    lept_parser_init(parser);
+    parser->allocator = allocator;
+}
+
+int lept_parser_parse(lept_parser* parser, lept_value* v, const char* json, size_t len) {
+    assert(parser != NULL);
+    return lept_parse_buffer(parser, NULL, v, json, len, parser->padding, 0, 0);
+}
+
+int lept_parser_parse_insitu(lept_parser* parser, lept_value* v, char* json, size_t len) {
+    assert(parser != NULL);
+    return lept_parse_buffer(parser, NULL, v, json, len, parser->padding, 1, 0);
+}
+
+int lept_parser_parse_sax(lept_parser* parser, const char* json, size_t len, const lept_handler* handler, void* ctx) {
+    assert(parser != NULL);
+    return lept_parse_sax_buffer(parser, json, len, parser->padding, handler, ctx);
+}
+
+/* The push parser keeps its position between chunks in s->state. Tokens split across chunks are
+ * collected in s->token and handed to lept_parse_number() or lept_parse_string_raw() once complete,
+ * so errors are the ones lept_parse() gives for the whole input. */
+
+enum {
+    LEPT_STREAM_VALUE,          /* before a value */
+    LEPT_STREAM_ARRAY_FIRST,    /* after '[' */
+    LEPT_STREAM_OBJECT_FIRST,   /* after '{' */
+    LEPT_STREAM_KEY,            /* after ',' in an object */
+    LEPT_STREAM_COLON,          /* after a key */
+    LEPT_STREAM_NEXT,           /* after a value */
+    LEPT_STREAM_STRING,
+    LEPT_STREAM_NUMBER,
+    LEPT_STREAM_LITERAL,
+    LEPT_STREAM_ERROR
+};
+
+#define LEPT_STREAM_FRAME(s, c) LEPT_FRAME(c, (s)->frame)
+#define ISNUMBERCHAR(ch)        (ISDIGIT(ch) || (ch) == '-' || (ch) == '+' || (ch) == '.' || (ch) == 'e' || (ch) == 'E')
+
+static void lept_stream_append(lept_stream* s, const char* p, size_t len) {
+    if (len == 0)
+        return;
+    if (s->token_len + len > s->token_size) {
+        size_t size = s->token_size == 0 ? LEPT_PARSE_STACK_INIT_SIZE : s->token_size;
+        while (s->token_len + len > size)
+            size += size >> 1;
+        s->token = (char*)LEPT_RESIZE(LEPT_ALLOCATOR(s->allocator), s->token, s->token_size, size);
+        s->token_size = size;
+    }
+    memcpy(s->token + s->token_len, p, len);
+    s->token_len += len;
+}
+
+/* A value is complete: in DOM mode it goes to its container, or becomes the root. */
+static void lept_stream_complete(lept_stream* s, lept_context* c, lept_value* v) {
+    lept_frame* f;
+    s->state = LEPT_STREAM_NEXT;
+    if (s->depth == 0) {
+        if (s->handler == NULL)
+            memcpy(&s->root, v, sizeof(lept_value));
+        return;
+    }
+    if (LEPT_STREAM_FRAME(s, c)->type == '[') {
+        if (s->handler == NULL)
+            memcpy(lept_context_push(c, sizeof(lept_value)), v, sizeof(lept_value));
+        f = LEPT_STREAM_FRAME(s, c);
+        f->count++;
+        f->owning |= s->handler == NULL && LEPT_HOLDS_STORAGE(v);
+    }
+    else if (s->handler == NULL)
+        memcpy(&((lept_member*)(c->stack + c->top - sizeof(lept_member)))->v, v, sizeof(lept_value));
+}
+
+static int lept_stream_scalar(lept_stream* s, lept_context* c, lept_value* v) {
+    if (s->handler != NULL && lept_sax_scalar(c, v) != LEPT_PARSE_OK)
+        return LEPT_PARSE_ABORTED;
+    lept_stream_complete(s, c, v);
+    return LEPT_PARSE_OK;
+}
+
+static int lept_stream_string(lept_stream* s, lept_context* c, const char* str, size_t len) {
+    lept_value v;
+    if (s->key) {
+        s->state = LEPT_STREAM_COLON;
+        LEPT_STREAM_FRAME(s, c)->count++;
+        if (s->handler != NULL)
+            return s->handler->key == NULL || s->handler->key(c->ctx, str, len) ? LEPT_PARSE_OK : LEPT_PARSE_ABORTED;
+        else {
+            lept_member m;
+            memcpy(m.k = (char*)lept_malloc(NULL, len + 1), str, len);
+            m.k[len] = '\0';
+            m.klen = len;
+            lept_init(&m.v);
+            memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
+            return LEPT_PARSE_OK;
+        }
+    }
+    if (s->handler != NULL) {
+        if (s->handler->string && !s->handler->string(c->ctx, str, len))
+            return LEPT_PARSE_ABORTED;
+    }
+    else if (len > LEPT_SIZE_MAX)
+        return LEPT_PARSE_SIZE_EXCEEDED;
+    else {
+        lept_init(&v);
+        lept_set_string(&v, str, len);
+    }
+    lept_stream_complete(s, c, &v);
+    return LEPT_PARSE_OK;
+}
+
+static int lept_stream_open(lept_stream* s, lept_context* c, char type) {
+    lept_frame f;
+    if (s->depth == c->max_depth)
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    c->json++;
+    if (s->handler != NULL) {
+        int (*start)(void* ctx) = type == '[' ? s->handler->start_array : s->handler->start_object;
+        if (start != NULL && !start(c->ctx))
+            return LEPT_PARSE_ABORTED;
+    }
+    f.parent = s->frame;
+    f.count = 0;
+    f.type = type;
+    f.owning = 0;
+    s->frame = c->top;
+    memcpy(lept_context_push(c, sizeof(lept_frame)), &f, sizeof(lept_frame));
+    s->depth++;
+    s->state = type == '[' ? LEPT_STREAM_ARRAY_FIRST : LEPT_STREAM_OBJECT_FIRST;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_stream_close(lept_stream* s, lept_context* c) {
+    lept_frame f;
+    lept_value v;
+    c->json++;
+    memcpy(&f, LEPT_STREAM_FRAME(s, c), sizeof(lept_frame));
+    if (s->handler == NULL && f.count > LEPT_SIZE_MAX)
+        return LEPT_PARSE_SIZE_EXCEEDED;
+    if (s->handler != NULL) {
+        if (lept_sax_end(c, f.type == '[' ? s->handler->end_array : s->handler->end_object, f.count) != LEPT_PARSE_OK)
+            return LEPT_PARSE_ABORTED;
+    }
+    else if (f.type == '[') {
+        lept_init(&v);
+        lept_set_array(&v, f.count);
+        if (f.count > 0)
+            memcpy(v.u.a.e, lept_context_pop(c, f.count * sizeof(lept_value)), f.count * sizeof(lept_value));
+        v.u.a.size = f.count;
+        if (!f.owning)
+            v.flags |= LEPT_FLAG_SCALARS;
+    }
+    else {
+        lept_init(&v);
+        lept_set_object(&v, f.count);
+        if (f.count > 0)
+            memcpy(v.u.o.m, lept_context_pop(c, f.count * sizeof(lept_member)), f.count * sizeof(lept_member));
+        v.u.o.size = f.count;
+        lept_index_build(&v);
+    }
+    lept_context_pop(c, sizeof(lept_frame));
+    s->frame = f.parent;
+    s->depth--;
+    lept_stream_complete(s, c, &v);
+    return LEPT_PARSE_OK;
+}
+
+/* The error lept_parse() gives for a character that cannot follow a value. */
+static int lept_stream_unexpected(lept_stream* s, lept_context* c) {
+    if (s->depth == 0)
+        return LEPT_PARSE_ROOT_NOT_SINGULAR;
+    return LEPT_STREAM_FRAME(s, c)->type == '[' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+}
+
+/* Parses the collected token as if it were the whole input, returning the bytes consumed in *used. */
+static int lept_stream_parse_token(lept_stream* s, lept_context* c, lept_value* v, char** str, size_t* len, size_t* used) {
+    const char* json = c->json, *end = c->end;
+    int ret;
+    c->json = s->token;
+    c->end = c->limit = s->token + s->token_len;
+    ret = v != NULL ? lept_parse_number(c, v) : lept_parse_string_raw(c, str, len);
+    *used = c->json - s->token;
+    c->json = json;
+    c->end = c->limit = end;
+    s->token_len = 0;
+    return ret;
+}
+
+/* At the end of the input (last), a partial token is complete. */
+static int lept_stream_number(lept_stream* s, lept_context* c, int last) {
+    const char* p = c->json;
+    lept_value v;
+    size_t len, used;
+    int ret;
+    while (p != c->end && ISNUMBERCHAR(*p))
+        p++;
+    if (s->token_len == 0 && p != c->end)   /* the whole number is in this chunk, what follows is left to the next state */
+        return (ret = lept_parse_number(c, &v)) != LEPT_PARSE_OK ? ret : lept_stream_scalar(s, c, &v);
+    lept_stream_append(s, c->json, p - c->json);
+    c->json = p;
+    if (p == c->end && !last)
+        return LEPT_PARSE_OK;
+    len = s->token_len;
+    if ((ret = lept_stream_parse_token(s, c, &v, NULL, NULL, &used)) != LEPT_PARSE_OK)
+        return ret;
+    if ((ret = lept_stream_scalar(s, c, &v)) != LEPT_PARSE_OK)
+        return ret;
+    return used == len ? LEPT_PARSE_OK : lept_stream_unexpected(s, c);
+}
+
+static int lept_stream_string_token(lept_stream* s, lept_context* c, int last) {
+    const char* p = c->json;
+    char* str;
+    size_t len, used;
+    int ret;
+    if (s->token_len == 0)
+        p++;    /* opening quote */
+    for (;;) {
+        if (s->escape) {
+            if (p == c->end)
+                break;
+            p++;
+            s->escape = 0;
+        }
+        p = lept_scan_string(p, c->end, c->end);
+        if (p == c->end)
+            break;
+        if (*p == '\\') {
+            s->escape = 1;
+            p++;
+        }
+        else if (*p == '\"') {
+            if (s->token_len == 0)
+                ret = lept_parse_string_raw(c, &str, &len);
+            else {
+                lept_stream_append(s, c->json, p + 1 - c->json);
+                c->json = p + 1;
+                ret = lept_stream_parse_token(s, c, NULL, &str, &len, &used);
+            }
+            return ret != LEPT_PARSE_OK ? ret : lept_stream_string(s, c, str, len);
+        }
+        else
+            p++;    /* control character, left for lept_parse_string_raw() to report */
+    }
+    lept_stream_append(s, c->json, p - c->json);
+    c->json = p;
+    if (!last)
+        return LEPT_PARSE_OK;
+    /* unterminated, but an earlier error in the string takes precedence */
+    ret = lept_stream_parse_token(s, c, NULL, &str, &len, &used);
+    assert(ret != LEPT_PARSE_OK);
+    return ret;
+}
+
+static int lept_stream_literal(lept_stream* s, lept_context* c, int last) {
+    lept_value v;
+    for (; s->literal[s->token_len] != '\0'; s->token_len++, c->json++) {
+        if (c->json == c->end)
+            return last ? LEPT_PARSE_INVALID_VALUE : LEPT_PARSE_OK;
+        if (*c->json != s->literal[s->token_len])
+            return LEPT_PARSE_INVALID_VALUE;
+    }
+    s->token_len = 0;
+    v.type = s->literal[0] == 't' ? LEPT_TRUE : s->literal[0] == 'f' ? LEPT_FALSE : LEPT_NULL;
+    v.flags = 0;
+    return lept_stream_scalar(s, c, &v);
+}
+
+/* Consumes the chunk in c, last tells whether the input ends with it. */
+static int lept_stream_run(lept_stream* s, lept_context* c, int last) {
+    int ret = LEPT_PARSE_OK;
+    while (ret == LEPT_PARSE_OK) {
+        if (s->state < LEPT_STREAM_STRING) {
+            lept_parse_whitespace(c);
+            if (c->json == c->end)
+                break;
+        }
+        else if (c->json == c->end && !last)
+            break;
+        switch (s->state) {
+            case LEPT_STREAM_VALUE:
+            case LEPT_STREAM_ARRAY_FIRST:
+                switch (*c->json) {
+                    case ']':
+                        if (s->state == LEPT_STREAM_ARRAY_FIRST) {
+                            ret = lept_stream_close(s, c);
+                            break;
+                        }
+                        s->state = LEPT_STREAM_NUMBER;
+                        break;
+                    case '[':
+                    case '{': ret = lept_stream_open(s, c, *c->json); break;
+                    case '"': s->key = 0; s->escape = 0; s->state = LEPT_STREAM_STRING; break;
+                    case 't': s->literal = "true";  s->state = LEPT_STREAM_LITERAL; break;
+                    case 'f': s->literal = "false"; s->state = LEPT_STREAM_LITERAL; break;
+                    case 'n': s->literal = "null";  s->state = LEPT_STREAM_LITERAL; break;
+                    default:  s->state = LEPT_STREAM_NUMBER; break;
+                }
+                break;
+            case LEPT_STREAM_OBJECT_FIRST:
+            case LEPT_STREAM_KEY:
+                if (*c->json == '}' && s->state == LEPT_STREAM_OBJECT_FIRST)
+                    ret = lept_stream_close(s, c);
+                else if (*c->json != '"')
+                    ret = LEPT_PARSE_MISS_KEY;
+                else {
+                    s->key = 1;
+                    s->escape = 0;
+                    s->state = LEPT_STREAM_STRING;
+                }
+                break;
+            case LEPT_STREAM_COLON:
+                if (*c->json != ':')
+                    ret = LEPT_PARSE_MISS_COLON;
+                else {
+                    c->json++;
+                    s->state = LEPT_STREAM_VALUE;
+                }
+                break;
+            case LEPT_STREAM_NEXT:
+                if (s->depth > 0 && *c->json == ',') {
+                    c->json++;
+                    s->state = LEPT_STREAM_FRAME(s, c)->type == '[' ? LEPT_STREAM_VALUE : LEPT_STREAM_KEY;
+                }
+                else if (s->depth > 0 && *c->json == (LEPT_STREAM_FRAME(s, c)->type == '[' ? ']' : '}'))
+                    ret = lept_stream_close(s, c);
+                else
+                    ret = lept_stream_unexpected(s, c);
+                break;
+            case LEPT_STREAM_STRING:  ret = lept_stream_string_token(s, c, last); break;
+            case LEPT_STREAM_NUMBER:  ret = lept_stream_number(s, c, last); break;
+            case LEPT_STREAM_LITERAL: ret = lept_stream_literal(s, c, last); break;
+            default: assert(0 && "invalid state");
+        }
+    }
+    return ret;
+}
+
+static void lept_stream_enter(lept_stream* s, lept_context* c, const char* json, size_t len) {
+    c->json = json;
+    c->end = c->limit = json + len;
+    c->insitu = 0;
+    c->lazy = 0;
+    c->doc = NULL;
+    c->paths = NULL;
+    c->allocator = LEPT_ALLOCATOR(s->allocator);
+    c->handler = s->handler;
+    c->ctx = s->ctx;
+    c->max_depth = s->max_depth > 0 ? s->max_depth : LEPT_PARSE_MAX_DEPTH;
+    c->stack = s->stack;
+    c->size = s->size;
+    c->top = s->top;
+}
+
+static int lept_stream_leave(lept_stream* s, lept_context* c, int ret) {
+    if (ret != LEPT_PARSE_OK) {
+        lept_context_unwind(c, s->frame, s->depth);
+        lept_free(&s->root);
+        s->frame = s->depth = 0;
+        s->state = LEPT_STREAM_ERROR;
+        s->error = ret;
+    }
+    s->stack = c->stack;
+    s->size = c->size;
+    s->top = c->top;
+    return ret;
+}
+
+void lept_stream_init(lept_stream* s, const lept_handler* handler, void* ctx) {
+    assert(s != NULL);
+    s->handler = handler;
+    s->ctx = ctx;
+    s->allocator = NULL;
+    s->max_depth = 0;
+    s->stack = s->token = NULL;
+    s->size = s->token_size = 0;
+    s->top = s->frame = s->depth = 0;
+    lept_init(&s->root);
+    lept_stream_reset(s);
+}
+
+/* Keeps the buffers for the next document. */
+void lept_stream_reset(lept_stream* s) {
+    lept_context c;
+    assert(s != NULL);
+    lept_stream_enter(s, &c, NULL, 0);
+    lept_stream_leave(s, &c, LEPT_PARSE_ABORTED);
+    s->state = LEPT_STREAM_VALUE;
+    s->error = LEPT_PARSE_OK;
+    s->token_len = s->top = s->frame = 0;
+    s->literal = NULL;
+    s->key = s->escape = 0;
+}
+
+/* Keeps the handler and allocator for reuse. */
+void lept_stream_free(lept_stream* s) {
+    const lept_allocator* allocator;
+    assert(s != NULL);
+    lept_stream_reset(s);
+    allocator = LEPT_ALLOCATOR(s->allocator);
+    if (s->stack != NULL)
+        LEPT_DEALLOC(allocator, s->stack);
+    if (s->token != NULL)
+        LEPT_DEALLOC(allocator, s->token);
+    s->stack = s->token = NULL;
+    s->size = s->token_size = 0;
+}
+
+int lept_stream_feed(lept_stream* s, const char* buf, size_t len) {
+    lept_context c;
+    assert(s != NULL && (buf != NULL || len == 0));
+    if (s->state == LEPT_STREAM_ERROR)
+        return s->error;
+    lept_stream_enter(s, &c, buf, len);
+    return lept_stream_leave(s, &c, lept_stream_run(s, &c, 0));
+}
+
+int lept_stream_finish(lept_stream* s) {
+    lept_context c;
+    int ret;
+    assert(s != NULL);
+    if (s->state == LEPT_STREAM_ERROR)
+        return s->error;
+    lept_stream_enter(s, &c, NULL, 0);
+    if ((ret = lept_stream_run(s, &c, 1)) == LEPT_PARSE_OK) {
+        switch (s->state) {
+            case LEPT_STREAM_VALUE:
+            case LEPT_STREAM_ARRAY_FIRST:   ret = LEPT_PARSE_EXPECT_VALUE; break;
+            case LEPT_STREAM_OBJECT_FIRST:
+            case LEPT_STREAM_KEY:           ret = LEPT_PARSE_MISS_KEY; break;
+            case LEPT_STREAM_COLON:         ret = LEPT_PARSE_MISS_COLON; break;
+            default:                        ret = s->depth == 0 ? LEPT_PARSE_OK : lept_stream_unexpected(s, &c); break;
+        }
+    }
+    return lept_stream_leave(s, &c, ret);
+}
+
+/*
+ * Maps the file at path, private and writable for in-situ parsing, or reads it into memory where mmap() is missing.
+ * *padding tells the readable bytes after the file, the rest of its last page. Returns NULL with errno set on failure.
+ */
+static char* lept_file_map(const lept_allocator* a, const char* path, int writable, int sequential, size_t* size, size_t* padding) {
+    char* map = NULL;
+#ifdef LEPT_MMAP
+    static char empty[LEPT_PARSE_PADDING];
+    struct stat st;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    int fd, e;
+    (void)a;
+    *size = 0;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) == 0 && (*size = (size_t)st.st_size) == 0)
+        map = empty;
+    else if (*size > 0) {
+        map = (char*)mmap(NULL, *size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == (char*)MAP_FAILED)
+            map = NULL;
+        else if (sequential)
+            posix_madvise(map, *size, POSIX_MADV_SEQUENTIAL);
+    }
+    e = errno;
+    close(fd);
+    errno = e;
+    *padding = map == empty ? sizeof(empty) : (page - *size % page) % page;
+#else
+    FILE* fp;
+    long n;
+    (void)writable;
+    (void)sequential;
+    if ((fp = fopen(path, "rb")) == NULL)
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (n = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        *size = (size_t)n;
+        *padding = LEPT_PARSE_PADDING;
+        map = (char*)LEPT_ALLOC(a, *size + *padding);
+        if (fread(map, 1, *size, fp) != *size) {
+            LEPT_DEALLOC(a, map);
+            map = NULL;
+        }
+    }
+    fclose(fp);
+#endif
+    return map;
+}
+
+static void lept_file_unmap(const lept_allocator* a, char* map, size_t size) {
+#ifdef LEPT_MMAP
+    (void)a;
+    if (size > 0)
+        munmap(map, size);
+#else
+    (void)size;
+    LEPT_DEALLOC(a, map);
+#endif
+}
+
+int lept_parse_file(lept_value* v, const char* path) {
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    size_t size, padding;
+    char* map;
+    int ret;
+    assert(v != NULL && path != NULL);
+    if ((map = lept_file_map(a, path, 0, 1, &size, &padding)) == NULL) {
+        lept_init(v);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    ret = lept_parse_buffer(NULL, NULL, v, map, size, padding, 0, 0);
+    lept_file_unmap(a, map, size);
+    return ret;
+}
+
+/* Reads the file at path into *buf, grown as needed to hold it and LEPT_PARSE_PADDING bytes more. */
+static int lept_file_read(const lept_allocator* a, const char* path, char** buf, size_t* capacity, size_t* len) {
+    size_t size = 0;
+    int ok = 0;
+#ifdef LEPT_MMAP
+    struct stat st;
+    ssize_t n = 0;
+    int fd, e;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+    if (fstat(fd, &st) == 0)
+        size = (size_t)st.st_size;
+#else
+    FILE* fp;
+    long n;
+    if ((fp = fopen(path, "rb")) == NULL)
+        return 0;
+    if (fseek(fp, 0, SEEK_END) == 0 && (n = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0)
+        size = (size_t)n;
+#endif
+    if (size + LEPT_PARSE_PADDING > *capacity) {
+        if (*buf != NULL)
+            LEPT_DEALLOC(a, *buf);
+        *capacity = size + LEPT_PARSE_PADDING;
+        *buf = (char*)LEPT_ALLOC(a, *capacity);
+    }
+#ifdef LEPT_MMAP
+    for (*len = 0; *len < size && (n = pread(fd, *buf + *len, size - *len, (off_t)*len)) > 0; *len += (size_t)n)
+        ;
+    ok = n >= 0;
+    e = errno;
+    close(fd);
+    errno = e;
+#else
+    *len = fread(*buf, 1, size, fp);
+    ok = !ferror(fp);
+    fclose(fp);
+#endif
+    return ok;
+}
+
+void lept_document_init(lept_document* d) {
+    assert(d != NULL);
+    lept_init(&d->root);
+    d->blocks = NULL;
+    d->top = d->end = d->last = NULL;
+    d->allocator = NULL;
+    d->error = LEPT_PARSE_OK;
+    d->map = NULL;
+    d->map_size = 0;
+    d->intern = LEPT_DOCUMENT_INTERN;
+    d->keys = NULL;
+    d->keys_count = d->keys_mask = 0;
+}
+
+/* Keeps the newest, largest, block for the next document. */
+void lept_document_reset(lept_document* d) {
+    lept_arena_block* b;
+    assert(d != NULL);
+    if (d->blocks != NULL) {
+        while ((b = d->blocks->next) != NULL) {
+            d->blocks->next = b->next;
+            LEPT_DEALLOC(LEPT_ALLOCATOR(d->allocator), b);
+        }
+        d->top = (char*)(d->blocks + 1);
+        d->last = NULL;
+    }
+    lept_init(&d->root);
+    d->error = LEPT_PARSE_OK;
+    if (d->map != NULL) {
+        lept_file_unmap(LEPT_ALLOCATOR(d->allocator), d->map, d->map_size);
+        d->map = NULL;
+        d->map_size = 0;
+    }
+}
+
+/* Keeps the allocator and the intern setting for reuse. */
+void lept_document_free(lept_document* d) {
+    lept_arena_block* b;
+    const lept_allocator* allocator;
+    size_t intern, i;
+    assert(d != NULL);
+    allocator = d->allocator;
+    if (d->map != NULL)
+        lept_file_unmap(LEPT_ALLOCATOR(allocator), d->map, d->map_size);
+    while ((b = d->blocks) != NULL) {
+        d->blocks = b->next;
+        LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), b);
+    }
+    if (d->keys != NULL) {
+        for (i = 0; i <= d->keys_mask; i++)
+            if (d->keys[i].k != NULL)
+                LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), d->keys[i].k);
+        LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), d->keys);
+    }
+    intern = d->intern;
+    lept_document_init(d);
+    d->allocator = allocator;
+    d->intern = intern;
+}
+
+const char* lept_document_intern(lept_document* d, const char* key, size_t klen) {
+    const char* k;
+    assert(d != NULL && key != NULL);
+    return (k = lept_intern_key(d, key, klen)) != NULL ? k : key;
+}
+
+int lept_document_parse(lept_document* d, lept_parser* parser, const char* json, size_t len) {
+    assert(d != NULL);
+    lept_document_reset(d);
+    return lept_parse_buffer(parser, d, &d->root, json, len, parser != NULL ? parser->padding : 0, 0, 0);
+}
+
+int lept_document_parse_lazy(lept_document* d, lept_parser* parser, const char* json, size_t len) {
+    assert(d != NULL);
+    lept_document_reset(d);
+    return lept_parse_buffer(parser, d, &d->root, json, len, parser != NULL ? parser->padding : 0, 0, 1);
+}
+
+/* The document keeps the file mapped while its values may borrow from it, and releases it at once otherwise. */
+int lept_document_parse_file(lept_document* d, lept_parser* parser, const char* path, int flags) {
+    const lept_allocator* a;
+    size_t padding;
+    int ret;
+    assert(d != NULL && path != NULL);
+    lept_document_reset(d);
+    a = LEPT_ALLOCATOR(d->allocator);
+    if ((d->map = lept_file_map(a, path, flags & LEPT_FILE_INSITU, !(flags & LEPT_FILE_LAZY), &d->map_size, &padding)) == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+    ret = lept_parse_buffer(parser, d, &d->root, d->map, d->map_size, padding, flags & LEPT_FILE_INSITU, flags & LEPT_FILE_LAZY);
+    if (ret != LEPT_PARSE_OK || !(flags & (LEPT_FILE_INSITU | LEPT_FILE_LAZY))) {
+        lept_file_unmap(a, d->map, d->map_size);
+        d->map = NULL;
+        d->map_size = 0;
+    }
+    return ret;
+}
+
+/* Parses the text of a lazy value where it stands, leaving its strings and containers lazy in turn. */
+static void lept_expand(lept_value* v) {
+    lept_context c;
+    lept_value e;
+    lept_document* d = LEPT_LAZY(v)->d;
+    int ret;
+    lept_context_init(&c, LEPT_LAZY(v)->json, LEPT_LAZY(v)->len, 0);
+    c.lazy = 1;
+    c.doc = d;
+    lept_context_acquire(&c, NULL);
+    ret = lept_parse_value(&c, &e);
+    lept_context_release(&c, NULL);
+    if (ret == LEPT_PARSE_OK) {
+        memcpy(v, &e, sizeof(lept_value));
+        return;
+    }
+    if (d->error == LEPT_PARSE_OK)
+        d->error = ret;
+    switch (v->type) {
+        case LEPT_STRING: lept_set_string_in(d, v, "", 0); break;
+        case LEPT_ARRAY:  lept_set_array_in(d, v, 0); break;
+        default:          lept_set_object_in(d, v, 0); break;
+    }
+}
+
+void lept_many_init(lept_many* m) {
+    assert(m != NULL);
+    lept_parser_init(&m->parser);
+    lept_document_init(&m->doc);
+    lept_parse_many(m, NULL, 0);
+}
+
+/* Keeps the allocators for reuse. */
+void lept_many_free(lept_many* m) {
+    assert(m != NULL);
+    lept_parser_free(&m->parser);
+    lept_document_free(&m->doc);
+    lept_parse_many(m, NULL, 0);
+}
+
+void lept_parse_many(lept_many* m, const char* json, size_t len) {
+    assert(m != NULL && (json != NULL || len == 0));
+    lept_document_reset(&m->doc);
+    m->error = LEPT_PARSE_OK;
+    m->line = m->offset = m->length = 0;
+    m->json = m->next = json;
+    m->end = m->limit = json + len;
+}
+
+/* Lines are found with memchr(), which C libraries vectorize, and each record is parsed within its line. */
+static int lept_many_step(lept_many* m) {
+    lept_context c;
+    const char* p, *nl;
+    m->error = LEPT_PARSE_OK;
+    do {
+        if ((p = m->next) == m->end)
+            return 0;
+        if ((nl = (const char*)memchr(p, '\n', m->end - p)) == NULL)
+            nl = m->next = m->end;
+        else
+            m->next = nl + 1;
+        m->line++;
+    } while (lept_scan_whitespace(p, nl, m->end + m->parser.padding) == nl);
+    m->offset = p - m->json;
+    m->length = nl - p;
+    /* the rest of the input is readable padding */
+    lept_context_init(&c, p, nl - p, m->limit - nl + m->parser.padding);
+    c.doc = &m->doc;
+    m->error = lept_parse_root(&c, &m->parser, &m->doc.root);
+    return 1;
+}
+
+int lept_many_next(lept_many* m) {
+    assert(m != NULL);
+    lept_document_reset(&m->doc);
+    return lept_many_step(m);
+}
+
+#ifdef LEPT_THREADS
+typedef struct {
+    lept_value v;
+    int error;
+    size_t line, offset, length;
+}lept_many_record;
+
+#define LEPT_SLOT_FREE  0
+#define LEPT_SLOT_BUSY  1   /* a worker parses a chunk into the slot */
+#define LEPT_SLOT_READY 2   /* the records of the chunk wait for their turn */
+
+typedef struct {
+    lept_many m;                /* of the worker, or of the chunk when ordered, its arena then keeping all records */
+    lept_many_record* records;  /* of the chunk, when ordered */
+    size_t count, capacity;
+    size_t lines;               /* of the chunk */
+    int state;
+}lept_many_slot;
+
+typedef struct {
+    const char* json, *next, *end;
+    int ordered;
+    int (*record)(void* ctx, lept_many* m);
+    void* ctx;
+    lept_many_slot* slots;
+    size_t nslots;
+    size_t task, deliver;       /* chunks taken, chunks passed to record() */
+    size_t line;                /* lines of the chunks passed to record() */
+    int delivering, stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+}lept_pool;
+
+typedef struct {
+    lept_pool* pool;
+    size_t id;
+}lept_worker;
+
+/* Takes the next chunk, which ends after a newline, under the lock. */
+static void lept_pool_take(lept_pool* pool, lept_many* m) {
+    const char* p = pool->next, *nl = NULL;
+    if ((size_t)(pool->end - p) > LEPT_MANY_CHUNK_SIZE)
+        nl = (const char*)memchr(p + LEPT_MANY_CHUNK_SIZE, '\n', pool->end - p - LEPT_MANY_CHUNK_SIZE);
+    pool->next = nl != NULL ? nl + 1 : pool->end;
+    lept_document_reset(&m->doc);
+    m->line = 0;
+    m->json = pool->json;
+    m->next = p;
+    m->end = pool->next;
+    m->limit = pool->end;
+}
+
+/* Line numbers are only known once the chunks before are counted, so records out of order have line 0. */
+static void lept_pool_unordered(lept_pool* pool, lept_many* m) {
+    size_t line;
+    int more;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->stop || pool->next == pool->end) {
+            pthread_mutex_unlock(&pool->lock);
+            return;
+        }
+        lept_pool_take(pool, m);
+        pthread_mutex_unlock(&pool->lock);
+        more = 1;   /* a chunk may hold no record */
+        do {
+            lept_document_reset(&m->doc);
+            if (!lept_many_step(m))
+                break;
+            line = m->line;
+            m->line = 0;
+            more = pool->record(pool->ctx, m);
+            m->line = line;
+        } while (more);
+        if (!more) {
+            pthread_mutex_lock(&pool->lock);
+            pool->stop = 1;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+}
+
+/* Passes the ready chunks in turn, called under the lock by one worker at a time. */
+static void lept_pool_deliver(lept_pool* pool) {
+    lept_many_slot* s;
+    size_t i;
+    int more = 1;
+    pool->delivering = 1;
+    while ((s = &pool->slots[pool->deliver % pool->nslots])->state == LEPT_SLOT_READY) {
+        more = !pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 0; i < s->count && more; i++) {
+            memcpy(&s->m.doc.root, &s->records[i].v, sizeof(lept_value));
+            s->m.error = s->records[i].error;
+            s->m.line = pool->line + s->records[i].line;
+            s->m.offset = s->records[i].offset;
+            s->m.length = s->records[i].length;
+            more = pool->record(pool->ctx, &s->m);
+        }
+        lept_document_reset(&s->m.doc);
+        s->count = 0;
+        pthread_mutex_lock(&pool->lock);
+        if (!more)
+            pool->stop = 1;
+        pool->line += s->lines;
+        pool->deliver++;
+        s->state = LEPT_SLOT_FREE;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pool->delivering = 0;
+}
+
+static void lept_pool_ordered(lept_pool* pool) {
+    lept_many_slot* s;
+    lept_many_record* r;
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->next != pool->end && pool->slots[pool->task % pool->nslots].state != LEPT_SLOT_FREE)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->stop || pool->next == pool->end) {
+            pthread_mutex_unlock(&pool->lock);
+            return;
+        }
+        s = &pool->slots[pool->task++ % pool->nslots];
+        s->state = LEPT_SLOT_BUSY;
+        lept_pool_take(pool, &s->m);
+        pthread_mutex_unlock(&pool->lock);
+        while (lept_many_step(&s->m)) {
+            if (s->count == s->capacity) {
+                size_t capacity = s->capacity + (s->capacity >> 1) + 16;
+                s->records = (lept_many_record*)LEPT_RESIZE(a, s->records,
+                    s->capacity * sizeof(lept_many_record), capacity * sizeof(lept_many_record));
+                s->capacity = capacity;
+            }
+            r = &s->records[s->count++];
+            memcpy(&r->v, &s->m.doc.root, sizeof(lept_value));
+            r->error = s->m.error;
+            r->line = s->m.line;
+            r->offset = s->m.offset;
+            r->length = s->m.length;
+            lept_init(&s->m.doc.root);
+        }
+        s->lines = s->m.line;
+        pthread_mutex_lock(&pool->lock);
+        s->state = LEPT_SLOT_READY;
+        if (!pool->delivering)
+            lept_pool_deliver(pool);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Runs work() on each of the n args of size bytes, the calling thread taking the first and those no thread took. */
+static void lept_run(void* (*work)(void* arg), void* args, size_t size, size_t n) {
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    pthread_t* ids = (pthread_t*)LEPT_ALLOC(a, n * sizeof(pthread_t));
+    char* started = (char*)LEPT_ALLOC(a, n);
+    size_t i;
+    for (i = 1; i < n; i++)
+        started[i] = pthread_create(&ids[i], NULL, work, (char*)args + i * size) == 0;
+    work(args);
+    for (i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(ids[i], NULL);
+        else
+            work((char*)args + i * size);
+    }
+    LEPT_DEALLOC(a, started);
+    LEPT_DEALLOC(a, ids);
+}
+
+static void* lept_pool_work(void* arg) {
+    lept_worker* w = (lept_worker*)arg;
+    if (w->pool->ordered)
+        lept_pool_ordered(w->pool);
+    else
+        lept_pool_unordered(w->pool, &w->pool->slots[w->id].m);
+    return NULL;
+}
+#endif
+
+/*
+ * Each worker takes chunks of LEPT_MANY_CHUNK_SIZE bytes in turn. When ordered, records wait in the arena of their
+ * chunk, of which twice as many as workers may be parsed, and the worker finishing the oldest one passes them on.
+ */
+int lept_parse_many_parallel(const char* json, size_t len, unsigned threads, int ordered, int (*record)(void* ctx, lept_many* m), void* ctx) {
+    lept_many m;
+    int more = 1;
+#ifdef LEPT_THREADS
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    lept_pool pool;
+    lept_worker* workers;
+    size_t i;
+#endif
+    assert((json != NULL || len == 0) && record != NULL);
+#ifdef LEPT_THREADS
+    if (threads > 1 && len > LEPT_MANY_CHUNK_SIZE) {
+        pool.json = pool.next = json;
+        pool.end = json + len;
+        pool.ordered = ordered;
+        pool.record = record;
+        pool.ctx = ctx;
+        pool.nslots = ordered ? 2 * (size_t)threads : threads;
+        pool.slots = (lept_many_slot*)LEPT_ALLOC(a, pool.nslots * sizeof(lept_many_slot));
+        for (i = 0; i < pool.nslots; i++) {
+            lept_many_init(&pool.slots[i].m);
+            pool.slots[i].records = NULL;
+            pool.slots[i].count = pool.slots[i].capacity = 0;
+            pool.slots[i].state = LEPT_SLOT_FREE;
+        }
+        pool.task = pool.deliver = pool.line = 0;
+        pool.delivering = pool.stop = 0;
+        pthread_mutex_init(&pool.lock, NULL);
+        pthread_cond_init(&pool.cond, NULL);
+        workers = (lept_worker*)LEPT_ALLOC(a, threads * sizeof(lept_worker));
+        for (i = 0; i < threads; i++) {
+            workers[i].pool = &pool;
+            workers[i].id = i;
+        }
+        /* a worker left without a thread finds the input taken */
+        lept_run(lept_pool_work, workers, sizeof(lept_worker), threads);
+        pthread_cond_destroy(&pool.cond);
+        pthread_mutex_destroy(&pool.lock);
+        for (i = 0; i < pool.nslots; i++) {
+            lept_many_free(&pool.slots[i].m);
+            if (pool.slots[i].records != NULL)
+                LEPT_DEALLOC(a, pool.slots[i].records);
+        }
+        LEPT_DEALLOC(a, workers);
+        LEPT_DEALLOC(a, pool.slots);
+        return pool.stop ? LEPT_PARSE_ABORTED : LEPT_PARSE_OK;
+    }
+#endif
+    (void)threads;
+    (void)ordered;
+    lept_many_init(&m);
+    lept_parse_many(&m, json, len);
+    while (more && lept_many_next(&m))
+        more = record(ctx, &m);
+    lept_many_free(&m);
+    return more ? LEPT_PARSE_OK : LEPT_PARSE_ABORTED;
+}
+
+#ifdef LEPT_THREADS
+typedef struct {
+    const char* begin, *end;    /* of the chunk scanned, then of the slice parsed */
+    const char* limit;          /* end of readable memory */
+    int escaped;                /* the chunk starts after an odd run of backslashes */
+    int quotes;                 /* parity of the quotes in the chunk */
+    ptrdiff_t depth[2];         /* change of nesting by the chunk, starting outside or inside of a string */
+    lept_context c;             /* elements of the slice wait on its stack */
+    lept_document doc;          /* storage of the elements */
+    size_t max_depth, count;
+    int owning, ret;
+}lept_slice;
+
+/*
+ * Bytes in a string are out of it when the chunk starts inside of one, so a single pass counts the nesting both ways.
+ * Backslashes are taken as escapes everywhere, which only differs from parsing for invalid input.
+ */
+static void* lept_slice_scan(void* arg) {
+    lept_slice* s = (lept_slice*)arg;
+    const char* p = s->begin, *q, *escaped = s->escaped ? p : NULL;
+    unsigned mask;
+    size_t n;
+    int in = 0;
+    s->depth[0] = s->depth[1] = 0;
+    while (p < s->end) {
+        if ((size_t)(s->end - p) >= LEPT_BLOCK_SIZE) {
+            mask = lept_scan_block(p);
+            n = LEPT_BLOCK_SIZE;
+        }
+        else
+            for (mask = 0, n = 0; p + n < s->end; n++)
+                mask |= (unsigned)(p[n] == '"' || p[n] == '\\' || p[n] == '[' || p[n] == ']' || p[n] == '{' || p[n] == '}') << n;
+        for (; mask != 0; mask &= mask - 1) {
+            if ((q = p + lept_ctz(mask)) == escaped)
+                continue;
+            switch (*q) {
+                case '\\':  escaped = q + 1; break;
+                case '"':   in ^= 1; break;
+                case '[':
+                case '{':   s->depth[in]++; break;
+                case ']':
+                case '}':   s->depth[in]--; break;
+            }
+        }
+        p += n;
+    }
+    s->quotes = in;
+    return NULL;
+}
+
+/* Finds the first comma between elements of the root array in the chunk, from its state at the start. */
+static const char* lept_slice_split(const lept_slice* s, int in, ptrdiff_t depth) {
+    const char* p, *escaped = s->escaped ? s->begin : NULL;
+    for (p = s->begin; p < s->end; p++) {
+        if (p == escaped)
+            continue;
+        switch (*p) {
+            case '\\':  escaped = p + 1; break;
+            case '"':   in ^= 1; break;
+            case '[':
+            case '{':   depth += !in; break;
+            case ']':
+            case '}':   depth -= !in; break;
+            case ',':   if (!in && depth == 1) return p; break;
+        }
+    }
+    return NULL;
+}
+
+/* Parses the elements of the slice, separated by commas, leaving them on the stack of its context. */
+static void* lept_slice_parse(void* arg) {
+    lept_slice* s = (lept_slice*)arg;
+    lept_context* c = &s->c;
+    lept_value e;
+    lept_context_init(c, s->begin, s->end - s->begin, s->limit - s->end);
+    c->doc = &s->doc;
+    lept_context_acquire(c, NULL);
+    c->max_depth = s->max_depth;
+    s->count = 0;
+    s->owning = 0;
+    lept_parse_whitespace(c);
+    while ((s->ret = lept_parse_value(c, &e)) == LEPT_PARSE_OK) {
+        memcpy(lept_context_push(c, sizeof(lept_value)), &e, sizeof(lept_value));
+        s->count++;
+        s->owning |= LEPT_HOLDS_STORAGE(&e);
+        lept_parse_whitespace(c);
+        if (c->json == c->end)
+            break;
+        if (*c->json != ',') {
+            s->ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+        c->json++;
+        lept_parse_whitespace(c);
+    }
+    return NULL;
+}
+
+/*
+ * Splits the root array into slices of whole elements parsed on a thread each. The input is cut into one chunk per
+ * thread and each chunk is scanned for its quotes and brackets, which tell the string state and nesting at the start
+ * of the next. Each chunk after the first then starts a slice at its first comma between elements of the root array.
+ * The arenas of the slices join the document, and only their element values are copied into the root array. Any
+ * error makes a sequential parse give its result.
+ */
+static int lept_document_parse_slices(lept_document* d, lept_parser* parser, const char* json, size_t len, size_t n) {
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    const char* begin = json, *end = json + len, *p;
+    size_t padding = parser != NULL ? parser->padding : 0;
+    size_t max_depth = parser != NULL && parser->max_depth > 0 ? parser->max_depth : LEPT_PARSE_MAX_DEPTH;
+    size_t i, k, count = 0;
+    ptrdiff_t depth = 1;
+    lept_slice* slices;
+    lept_arena_block* b;
+    int in = 0, ret = LEPT_PARSE_OK, owning = 0;
+    begin = lept_scan_whitespace(begin, end, end + padding);
+    while (end > begin && ISWHITESPACE(end[-1]))
+        end--;
+    if (end - begin < 2 || *begin++ != '[' || *--end != ']')
+        return -1;
+    slices = (lept_slice*)LEPT_ALLOC(a, n * sizeof(lept_slice));
+    for (i = 0; i < n; i++) {
+        slices[i].begin = begin + (end - begin) / n * i;
+        slices[i].end = i + 1 < n ? begin + (end - begin) / n * (i + 1) : end;
+        for (p = slices[i].begin; p > begin && p[-1] == '\\'; p--)
+            ;
+        slices[i].escaped = (slices[i].begin - p) & 1;
+    }
+    lept_run(lept_slice_scan, slices, sizeof(lept_slice), n);
+    /* chunks become slices, those without a comma between elements joining the slice before */
+    for (i = k = 0; i < n; i++) {
+        p = i == 0 ? begin - 1 : lept_slice_split(&slices[i], in, depth);
+        depth += slices[i].depth[in];
+        in ^= slices[i].quotes;
+        if (p != NULL) {
+            if (k > 0)
+                slices[k - 1].end = p;
+            slices[k].begin = p + 1;
+            slices[k].limit = end + 1 + padding;
+            slices[k].max_depth = max_depth - 1;
+            lept_document_init(&slices[k].doc);
+            slices[k].doc.allocator = d->allocator;
+            slices[k].doc.intern = 0; /* the keys join d with the arena */
+            k++;
+        }
+    }
+    slices[k - 1].end = end;
+    lept_run(lept_slice_parse, slices, sizeof(lept_slice), k);
+    for (i = 0; i < k; i++) {
+        count += slices[i].count;
+        owning |= slices[i].owning;
+        if (slices[i].ret != LEPT_PARSE_OK)
+            ret = slices[i].ret;
+    }
+    if (ret == LEPT_PARSE_OK && count > LEPT_SIZE_MAX)
+        ret = LEPT_PARSE_SIZE_EXCEEDED;
+    if (ret == LEPT_PARSE_OK) {
+        lept_set_array_in(d, &d->root, count);
+        for (i = count = 0; i < k; i++) {
+            memcpy(d->root.u.a.e + count, slices[i].c.stack, slices[i].count * sizeof(lept_value));
+            count += slices[i].count;
+            if ((b = slices[i].doc.blocks) != NULL) {
+                while (b->next != NULL)
+                    b = b->next;
+                b->next = d->blocks->next;
+                d->blocks->next = slices[i].doc.blocks;
+            }
+        }
+        d->root.u.a.size = count;
+        if (!owning)
+            d->root.flags |= LEPT_FLAG_SCALARS;
+    }
+    else
+        for (i = 0; i < k; i++)
+            lept_document_free(&slices[i].doc);
+    for (i = 0; i < k; i++)
+        lept_context_release(&slices[i].c, NULL);
+    LEPT_DEALLOC(a, slices);
+    return ret;
+}
+#endif
+
+int lept_document_parse_parallel(lept_document* d, lept_parser* parser, const char* json, size_t len, unsigned threads) {
+    assert(d != NULL && (json != NULL || len == 0));
+#ifdef LEPT_THREADS
+    if (threads > len / LEPT_SLICE_MIN_SIZE)
+        threads = (unsigned)(len / LEPT_SLICE_MIN_SIZE);
+    if (threads > 1) {
+        lept_document_reset(d);
+        if (lept_document_parse_slices(d, parser, json, len, threads) == LEPT_PARSE_OK)
+            return LEPT_PARSE_OK;
+    }
+#else
+    (void)threads;
+#endif
+    return lept_document_parse(d, parser, json, len);
+}
+
+/* The buffer and the scratch stack of parser are kept from file to file. */
+static void lept_file_parse(lept_parser* parser, const char* path, lept_file_result* r, char** buf, size_t* capacity) {
+    size_t len;
+    lept_init(&r->v);
+    r->errnum = 0;
+    if (lept_file_read(LEPT_ALLOCATOR(NULL), path, buf, capacity, &len))
+        r->error = lept_parser_parse(parser, &r->v, *buf, len);
+    else {
+        r->error = LEPT_PARSE_FILE_ERROR;
+        r->errnum = errno;
+    }
+}
+
+#ifdef LEPT_URING
+#ifndef LEPT_URING_ENTRIES
+#define LEPT_URING_ENTRIES 32 /* reads in flight on each thread */
+#endif
+
+/* An io_uring driven through raw system calls, with a buffer per entry kept from batch to batch. */
+typedef struct {
+    int fd;
+    unsigned* sq_head, *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring, *cq_ring;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned tail;                      /* of the entries queued but not yet submitted */
+    int leak;                           /* reads may still land in the buffers, which are never freed */
+    struct {
+        int fd;
+        char* buf;
+        size_t capacity, size, len;
+        struct iovec iov;
+    }files[LEPT_URING_ENTRIES];
+}lept_uring;
+
+/* Returns 0 where io_uring is missing or disabled. */
+static int lept_uring_init(lept_uring* u) {
+    struct io_uring_params p;
+    size_t i;
+    memset(&p, 0, sizeof(p));
+    u->leak = 0;
+    if ((u->fd = (int)syscall(__NR_io_uring_setup, LEPT_URING_ENTRIES, &p)) < 0)
+        return 0;
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQ_RING);
+    u->cq_ring = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_CQ_RING);
+    u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQES);
+    if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || u->sqes == (struct io_uring_sqe*)MAP_FAILED) {
+        if (u->sq_ring != MAP_FAILED)
+            munmap(u->sq_ring, u->sq_size);
+        if (u->cq_ring != MAP_FAILED)
+            munmap(u->cq_ring, u->cq_size);
+        if (u->sqes != (struct io_uring_sqe*)MAP_FAILED)
+            munmap(u->sqes, u->sqes_size);
+        close(u->fd);
+        return 0;
+    }
+    u->sq_head = (unsigned*)((char*)u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned*)((char*)u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned*)((char*)u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((char*)u->sq_ring + p.sq_off.array);
+    u->cq_head = (unsigned*)((char*)u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned*)((char*)u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned*)((char*)u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)((char*)u->cq_ring + p.cq_off.cqes);
+    u->tail = *u->sq_tail;
+    for (i = 0; i < LEPT_URING_ENTRIES; i++) {
+        u->files[i].buf = NULL;
+        u->files[i].capacity = 0;
+    }
+    return 1;
+}
+
+static void lept_uring_free(lept_uring* u) {
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    size_t i;
+    munmap(u->sqes, u->sqes_size);
+    munmap(u->cq_ring, u->cq_size);
+    munmap(u->sq_ring, u->sq_size);
+    close(u->fd);
+    for (i = 0; i < LEPT_URING_ENTRIES && !u->leak; i++)
+        if (u->files[i].buf != NULL)
+            LEPT_DEALLOC(a, u->files[i].buf);
+}
+
+/* Queues a read of the rest of file i, submitted by the next lept_uring_enter(). */
+static void lept_uring_read(lept_uring* u, size_t i) {
+    unsigned index = u->tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[index];
+    size_t len = u->files[i].size - u->files[i].len;
+    u->files[i].iov.iov_base = u->files[i].buf + u->files[i].len;
+    u->files[i].iov.iov_len = len < 0x40000000 ? len : 0x40000000;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = u->files[i].fd;
+    sqe->addr = (uint64_t)(uintptr_t)&u->files[i].iov;
+    sqe->len = 1;
+    sqe->off = (uint64_t)u->files[i].len;
+    sqe->user_data = (uint64_t)i;
+    u->sq_array[index] = index;
+    u->tail++;
+}
+
+/* Submits the queued reads and waits for a completion. */
+static int lept_uring_enter(lept_uring* u) {
+    long ret;
+    __atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+    do
+        ret = syscall(__NR_io_uring_enter, u->fd, u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE), 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    while (ret < 0 && errno == EINTR);
+    return ret >= 0;
+}
+
+/*
+ * Waits for the pending reads after lept_uring_enter() failed, taking back those the kernel did not take yet.
+ * Returns 0 when it cannot wait either.
+ */
+static int lept_uring_drain(lept_uring* u, size_t pending) {
+    unsigned head;
+    pending -= u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    u->tail = *u->sq_head;
+    __atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+    while (pending > 0) {
+        for (head = *u->cq_head; head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE); head++)
+            pending--;
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        if (pending > 0 && syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Opens the files, submits the reads of all at once, then parses each file as soon as it is read. Returns 0 when the
+ * ring fails, the unfinished files being read again with pread() into a buffer of their own once the reads in flight
+ * are over, or else the buffers of the ring are leaked.
+ */
+static int lept_uring_files(lept_uring* u, lept_parser* parser, const char* const* paths, lept_file_result* results, size_t n) {
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    size_t i, pending = 0;
+    unsigned head;
+    struct stat st;
+    assert(n <= LEPT_URING_ENTRIES);
+    for (i = 0; i < n; i++) {
+        lept_init(&results[i].v);
+        results[i].error = LEPT_PARSE_OK;
+        results[i].errnum = 0;
+        if ((u->files[i].fd = open(paths[i], O_RDONLY)) < 0 || fstat(u->files[i].fd, &st) != 0) {
+            results[i].error = LEPT_PARSE_FILE_ERROR;
+            results[i].errnum = errno;
+            if (u->files[i].fd >= 0)
+                close(u->files[i].fd);
+            u->files[i].fd = -1;
+            continue;
+        }
+        u->files[i].size = (size_t)st.st_size;
+        u->files[i].len = 0;
+        if (u->files[i].size + LEPT_PARSE_PADDING > u->files[i].capacity) {
+            if (u->files[i].buf != NULL)
+                LEPT_DEALLOC(a, u->files[i].buf);
+            u->files[i].capacity = u->files[i].size + LEPT_PARSE_PADDING;
+            u->files[i].buf = (char*)LEPT_ALLOC(a, u->files[i].capacity);
+        }
+        if (u->files[i].size > 0) {
+            lept_uring_read(u, i);
+            pending++;
+        }
+    }
+    for (i = 0; i < n; i++)
+        if (u->files[i].fd >= 0 && u->files[i].size == 0) {
+            close(u->files[i].fd);
+            u->files[i].fd = -1;
+            results[i].error = lept_parser_parse(parser, &results[i].v, u->files[i].buf, 0);
+        }
+    while (pending > 0) {
+        if (!lept_uring_enter(u)) {
+            char* buf = NULL;
+            size_t capacity = 0;
+            if (!lept_uring_drain(u, pending))
+                u->leak = 1;
+            for (i = 0; i < n; i++)
+                if (u->files[i].fd >= 0) {
+                    close(u->files[i].fd);
+                    lept_file_parse(parser, paths[i], &results[i], &buf, &capacity);
+                }
+            if (buf != NULL)
+                LEPT_DEALLOC(a, buf);
+            return 0;
+        }
+        for (head = *u->cq_head; head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE); head++) {
+            struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+            i = (size_t)cqe->user_data;
+            if (cqe->res > 0 && (u->files[i].len += (size_t)cqe->res) < u->files[i].size) {
+                lept_uring_read(u, i);
+                continue;
+            }
+            close(u->files[i].fd);
+            u->files[i].fd = -1;
+            pending--;
+            if (cqe->res < 0) {
+                results[i].error = LEPT_PARSE_FILE_ERROR;
+                results[i].errnum = -cqe->res;
+            }
+            else
+                results[i].error = lept_parser_parse(parser, &results[i].v, u->files[i].buf, u->files[i].len);
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 1;
+}
+#endif
+
+typedef struct {
+    const char* const* paths;
+    lept_file_result* results;
+    size_t n, next;
+    unsigned threads;
+#ifdef LEPT_THREADS
+    pthread_mutex_t lock;
+#endif
+}lept_batch;
+
+/* Takes up to max files, fewer when they would leave other threads without any. */
+static size_t lept_batch_take(lept_batch* batch, size_t max, size_t* first) {
+    size_t n;
+#ifdef LEPT_THREADS
+    pthread_mutex_lock(&batch->lock);
+#endif
+    n = (batch->n - batch->next) / batch->threads;
+    n = n > max ? max : n > 0 ? n : batch->next < batch->n;
+    *first = batch->next;
+    batch->next += n;
+#ifdef LEPT_THREADS
+    pthread_mutex_unlock(&batch->lock);
+#endif
+    return n;
+}
+
+/* Reads the files a batch at a time through io_uring where there is one, or else one file at a time. */
+static void* lept_batch_work(void* arg) {
+    lept_batch* batch = *(lept_batch**)arg;
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    lept_parser parser;
+    char* buf = NULL;
+    size_t capacity = 0, i;
+#ifdef LEPT_URING
+    lept_uring* u = (lept_uring*)LEPT_ALLOC(a, sizeof(lept_uring));
+    size_t n;
+#endif
+    lept_parser_init(&parser);
+    parser.padding = LEPT_PARSE_PADDING;
+#ifdef LEPT_URING
+    if (lept_uring_init(u)) {
+        while ((n = lept_batch_take(batch, LEPT_URING_ENTRIES, &i)) > 0)
+            if (!lept_uring_files(u, &parser, batch->paths + i, batch->results + i, n))
+                break;
+        lept_uring_free(u);
+    }
+    if (!u->leak)                       /* the reads left in flight hold the iovecs of u */
+        LEPT_DEALLOC(a, u);
+#endif
+    while (lept_batch_take(batch, 1, &i) > 0)
+        lept_file_parse(&parser, batch->paths[i], &batch->results[i], &buf, &capacity);
+    if (buf != NULL)
+        LEPT_DEALLOC(a, buf);
+    lept_parser_free(&parser);
+    return NULL;
+}
+
+/*
+ * With a single thread the files are taken in order. Where io_uring is missing, a thread blocks in each pending read,
+ * so threads beyond the number of cores keep more reads in flight.
+ */
+size_t lept_parse_files(const char* const* paths, size_t n, lept_file_result* results, unsigned threads) {
+    lept_batch batch, *self = &batch;
+    size_t i, failed = 0;
+#ifdef LEPT_THREADS
+    const lept_allocator* a = LEPT_ALLOCATOR(NULL);
+    lept_batch** workers;
+#endif
+    assert((paths != NULL && results != NULL) || n == 0);
+    if (threads > n)
+        threads = (unsigned)n;
+    batch.paths = paths;
+    batch.results = results;
+    batch.n = n;
+    batch.next = 0;
+    batch.threads = threads > 1 ? threads : 1;
+#ifdef LEPT_THREADS
+    pthread_mutex_init(&batch.lock, NULL);
+    if (threads > 1) {
+        workers = (lept_batch**)LEPT_ALLOC(a, threads * sizeof(lept_batch*));
+        for (i = 0; i < threads; i++)
+            workers[i] = &batch;
+        lept_run(lept_batch_work, workers, sizeof(lept_batch*), threads);
+        LEPT_DEALLOC(a, workers);
+    }
+    else
+#endif
+    if (n > 0)
+        lept_batch_work(&self);
+#ifdef LEPT_THREADS
+    pthread_mutex_destroy(&batch.lock);
+#endif
+    for (i = 0; i < n; i++)
+        failed += results[i].error != LEPT_PARSE_OK;
+    return failed;
+}
+
+/*
+ * Numbers and integers are followed by an entry with their bits, strings and keys hold the offset of their length in
+ * t->strings, arrays and objects the index past the entry ending them, which holds their count. While a container is
+ * parsed, its entry holds the index of the one around it instead, the innermost open one being t->open.
+ */
+#define LEPT_TAPE_KEY           8   /* tags after those of lept_type */
+#define LEPT_TAPE_END           9
+#define LEPT_TAPE_ENTRY(tag, x) ((uint64_t)(tag) << 56 | (uint64_t)(x))
+#define LEPT_TAPE_TAG(t, i)     ((int)((t)->tape[i] >> 56))
+#define LEPT_TAPE_PAYLOAD(t, i) ((size_t)((t)->tape[i] & ((UINT64_C(1) << 56) - 1)))
+
+static uint64_t* lept_tape_push(lept_tape* t, size_t n) {
+    if (t->size + n > t->capacity) {
+        size_t capacity = t->capacity + (t->capacity >> 1) + 64;
+        t->tape = (uint64_t*)LEPT_RESIZE(LEPT_ALLOCATOR(t->allocator), t->tape, t->capacity * sizeof(uint64_t), capacity * sizeof(uint64_t));
+        t->capacity = capacity;
+    }
+    t->size += n;
+    return t->tape + t->size - n;
+}
+
+static int lept_tape_chars(lept_tape* t, int tag, const char* s, size_t len) {
+    size_t size = sizeof(size_t) + len + 1;
+    char* p;
+    if (t->strings_size + size > t->strings_capacity) {
+        size_t capacity = t->strings_capacity + (t->strings_capacity >> 1) + 256;
+        if (capacity < t->strings_size + size)
+            capacity = t->strings_size + size;
+        t->strings = (char*)LEPT_RESIZE(LEPT_ALLOCATOR(t->allocator), t->strings, t->strings_capacity, capacity);
+        t->strings_capacity = capacity;
+    }
+    *lept_tape_push(t, 1) = LEPT_TAPE_ENTRY(tag, t->strings_size);
+    p = t->strings + t->strings_size;
+    memcpy(p, &len, sizeof(size_t));
+    memcpy(p + sizeof(size_t), s, len);
+    p[sizeof(size_t) + len] = '\0';
+    t->strings_size += size;
+    return 1;
+}
+
+static int lept_tape_null(void* ctx) {
+    *lept_tape_push((lept_tape*)ctx, 1) = LEPT_TAPE_ENTRY(LEPT_NULL, 0);
+    return 1;
+}
+
+static int lept_tape_boolean(void* ctx, int b) {
+    *lept_tape_push((lept_tape*)ctx, 1) = LEPT_TAPE_ENTRY(b ? LEPT_TRUE : LEPT_FALSE, 0);
+    return 1;
+}
+
+static int lept_tape_number(void* ctx, double n) {
+    uint64_t* e = lept_tape_push((lept_tape*)ctx, 2);
+    e[0] = LEPT_TAPE_ENTRY(LEPT_NUMBER, 0);
+    memcpy(&e[1], &n, sizeof(double));
+    return 1;
+}
+
+static int lept_tape_integer(void* ctx, int64_t i) {
+    uint64_t* e = lept_tape_push((lept_tape*)ctx, 2);
+    e[0] = LEPT_TAPE_ENTRY(LEPT_INTEGER, 0);
+    memcpy(&e[1], &i, sizeof(int64_t));
+    return 1;
+}
+
+static int lept_tape_string(void* ctx, const char* s, size_t len) {
+    return lept_tape_chars((lept_tape*)ctx, LEPT_STRING, s, len);
+}
+
+static int lept_tape_key(void* ctx, const char* k, size_t klen) {
+    return lept_tape_chars((lept_tape*)ctx, LEPT_TAPE_KEY, k, klen);
+}
+
+static int lept_tape_open(lept_tape* t, int tag) {
+    *lept_tape_push(t, 1) = LEPT_TAPE_ENTRY(tag, t->open);
+    t->open = t->size - 1;
+    return 1;
+}
+
+static int lept_tape_start_array(void* ctx) {
+    return lept_tape_open((lept_tape*)ctx, LEPT_ARRAY);
+}
+
+static int lept_tape_start_object(void* ctx) {
+    return lept_tape_open((lept_tape*)ctx, LEPT_OBJECT);
+}
+
+static int lept_tape_close(void* ctx, size_t count) {
+    lept_tape* t = (lept_tape*)ctx;
+    size_t start = t->open;
+    *lept_tape_push(t, 1) = LEPT_TAPE_ENTRY(LEPT_TAPE_END, count);
+    t->open = LEPT_TAPE_PAYLOAD(t, start);
+    t->tape[start] = LEPT_TAPE_ENTRY(LEPT_TAPE_TAG(t, start), t->size);
+    return 1;
+}
+
+void lept_tape_init(lept_tape* t) {
+    assert(t != NULL);
+    t->tape = NULL;
+    t->size = t->capacity = 0;
+    t->strings = NULL;
+    t->strings_size = t->strings_capacity = 0;
+    t->allocator = NULL;
+    t->open = 0;
+}
+
+/* Keeps the allocator for reuse. */
+void lept_tape_free(lept_tape* t) {
+    const lept_allocator* allocator;
+    assert(t != NULL);
+    allocator = t->allocator;
+    if (t->tape != NULL)
+        LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), t->tape);
+    if (t->strings != NULL)
+        LEPT_DEALLOC(LEPT_ALLOCATOR(allocator), t->strings);
+    lept_tape_init(t);
+    t->allocator = allocator;
 }
 
-int lept_parse(lept_value* v, const char* json) {
-    lept_context c;
+/* The tape is written by the SAX events in one pass, growing only its two buffers. */
+int lept_tape_parse(lept_tape* t, lept_parser* parser, const char* json, size_t len) {
+    static const lept_handler handler = {
+        lept_tape_null, lept_tape_boolean, lept_tape_number, lept_tape_integer, lept_tape_string, lept_tape_key,
+        lept_tape_start_array, lept_tape_close, lept_tape_start_object, lept_tape_close
+    };
     int ret;
-    assert(v != NULL);
-    c.json = json;
-    c.stack = NULL;
-    c.size = c.top = 0;
-    lept_init(v);
-    lept_parse_whitespace(&c);
-    if ((ret = lept_parse_value(&c, v)) == LEPT_PARSE_OK) {
-        lept_parse_whitespace(&c);
-        if (*c.json != '\0') {
-            v->type = LEPT_NULL;
-            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
-        }
-    }
-    assert(c.top == 0);
-    free(c.stack);
+    assert(t != NULL);
+    t->size = t->strings_size = t->open = 0;
+    if ((ret = lept_parse_sax_buffer(parser, json, len, parser != NULL ? parser->padding : 0, &handler, t)) != LEPT_PARSE_OK)
+        t->size = t->strings_size = 0;
     return ret;
 }
 
+lept_type lept_tape_get_type(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && LEPT_TAPE_TAG(t, i) < LEPT_TAPE_KEY);
+    return (lept_type)LEPT_TAPE_TAG(t, i);
+}
+
+int lept_tape_get_boolean(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_TRUE || LEPT_TAPE_TAG(t, i) == LEPT_FALSE));
+    return LEPT_TAPE_TAG(t, i) == LEPT_TRUE;
+}
+
+double lept_tape_get_number(const lept_tape* t, size_t i) {
+    double n;
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_NUMBER || LEPT_TAPE_TAG(t, i) == LEPT_INTEGER));
+    if (LEPT_TAPE_TAG(t, i) == LEPT_INTEGER)
+        return (double)lept_tape_get_int64(t, i);
+    memcpy(&n, &t->tape[i + 1], sizeof(double));
+    return n;
+}
+
+int64_t lept_tape_get_int64(const lept_tape* t, size_t i) {
+    int64_t n;
+    assert(t != NULL && i < t->size && LEPT_TAPE_TAG(t, i) == LEPT_INTEGER);
+    memcpy(&n, &t->tape[i + 1], sizeof(int64_t));
+    return n;
+}
+
+const char* lept_tape_get_string(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_STRING || LEPT_TAPE_TAG(t, i) == LEPT_TAPE_KEY));
+    return t->strings + LEPT_TAPE_PAYLOAD(t, i) + sizeof(size_t);
+}
+
+size_t lept_tape_get_string_length(const lept_tape* t, size_t i) {
+    size_t len;
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_STRING || LEPT_TAPE_TAG(t, i) == LEPT_TAPE_KEY));
+    memcpy(&len, t->strings + LEPT_TAPE_PAYLOAD(t, i), sizeof(size_t));
+    return len;
+}
+
+size_t lept_tape_get_size(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_ARRAY || LEPT_TAPE_TAG(t, i) == LEPT_OBJECT));
+    return LEPT_TAPE_PAYLOAD(t, LEPT_TAPE_PAYLOAD(t, i) - 1);
+}
+
+size_t lept_tape_first(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_ARRAY || LEPT_TAPE_TAG(t, i) == LEPT_OBJECT));
+    return i + 1;
+}
+
+size_t lept_tape_end(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && (LEPT_TAPE_TAG(t, i) == LEPT_ARRAY || LEPT_TAPE_TAG(t, i) == LEPT_OBJECT));
+    return LEPT_TAPE_PAYLOAD(t, i) - 1;
+}
+
+size_t lept_tape_next(const lept_tape* t, size_t i) {
+    assert(t != NULL && i < t->size && LEPT_TAPE_TAG(t, i) != LEPT_TAPE_END);
+    if (LEPT_TAPE_TAG(t, i) == LEPT_TAPE_KEY)
+        i++;
+    switch (LEPT_TAPE_TAG(t, i)) {
+        case LEPT_NUMBER:
+        case LEPT_INTEGER: return i + 2;
+        case LEPT_ARRAY:
+        case LEPT_OBJECT:  return LEPT_TAPE_PAYLOAD(t, i);
+        default:           return i + 1;
+    }
+}
+
+size_t lept_tape_get_array_element(const lept_tape* t, size_t i, size_t index) {
+    size_t e;
+    assert(t != NULL && i < t->size && LEPT_TAPE_TAG(t, i) == LEPT_ARRAY && index < lept_tape_get_size(t, i));
+    for (e = i + 1; index > 0; index--)
+        e = lept_tape_next(t, e);
+    return e;
+}
+
+size_t lept_tape_find_object_value(const lept_tape* t, size_t i, const char* key, size_t klen) {
+    size_t k, end;
+    assert(t != NULL && i < t->size && LEPT_TAPE_TAG(t, i) == LEPT_OBJECT && key != NULL);
+    for (k = i + 1, end = LEPT_TAPE_PAYLOAD(t, i) - 1; k != end; k = lept_tape_next(t, k))
+        if (lept_tape_get_string_length(t, k) == klen && memcmp(lept_tape_get_string(t, k), key, klen) == 0)
+            return k + 1;
+    return LEPT_KEY_NOT_EXIST;
+}
+
 static void lept_stringify_string(lept_context* c, const char* s, size_t len) {
     static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
     size_t i, size;
@@ -348,8 +3057,15 @@ static void lept_stringify_string(lept_context* c, const char* s, size_t len) {
     p = head = lept_context_push(c, size = len * 6 + 2); /* "\u00xx..." */
     *p++ = '"';
     for (i = 0; i < len; i++) {
-        unsigned char ch = (unsigned char)s[i];
-        switch (ch) {
+        unsigned char ch;
+        size_t run = lept_scan_string(s + i, s + len, s + len) - (s + i);
+        if (run > 0) {
+            memcpy(p, s + i, run);
+            p += run;
+            if ((i += run) == len)
+                break;
+        }
+        switch (ch = (unsigned char)s[i]) {
             case '\"': *p++ = '\\'; *p++ = '\"'; break;
             case '\\': *p++ = '\\'; *p++ = '\\'; break;
             case '\b': *p++ = '\\'; *p++ = 'b';  break;
@@ -371,42 +3087,130 @@ static void lept_stringify_string(lept_context* c, const char* s, size_t len) {
     c->top -= size - (p - head);
 }
 
-static void lept_stringify_value(lept_context* c, const lept_value* v) {
-    size_t i;
+static void lept_stringify_int64(lept_context* c, int64_t i) {
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char buffer[20], *p = buffer + sizeof(buffer);
+    uint64_t u = i < 0 ? 0 - (uint64_t)i : (uint64_t)i;
+    unsigned d;
+    while (u >= 100) {
+        d = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    if (u >= 10) {
+        d = (unsigned)u * 2;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    else
+        *--p = (char)('0' + u);
+    if (i < 0)
+        *--p = '-';
+    PUTS(c, p, buffer + sizeof(buffer) - p);
+}
+
+/* sprintf() writes the decimal point of the locale, which is put back to a period. */
+static void lept_stringify_number(lept_context* c, double n) {
+    const char* point = localeconv()->decimal_point;
+    char* s = (char*)lept_context_push(c, 32), *q;
+    size_t len = sprintf(s, "%.17g", n), plen = strlen(point);
+    if (strcmp(point, ".") != 0 && plen > 0 && (q = strstr(s, point)) != NULL) {
+        *q = '.';
+        memmove(q + 1, q + plen, len - (q - s) - plen);
+        len -= plen - 1;
+    }
+    c->top -= 32 - len;
+}
+
+/* Containers are written without recursion, with a stack of those still open beside the output. */
+
+typedef struct {
+    const lept_value* v;
+    size_t i;               /* next element or member */
+}lept_stringify_frame;
+
+/* Writes v, or only opens it if it is a nonempty container, returning whether it did the latter. */
+static int lept_stringify_node(lept_context* c, const lept_value* v) {
+    if (LEPT_OWNS_STORAGE(v))
+        LEPT_EXPAND(v);
     switch (v->type) {
-        case LEPT_NULL:   PUTS(c, "null",  4); break;
-        case LEPT_FALSE:  PUTS(c, "false", 5); break;
-        case LEPT_TRUE:   PUTS(c, "true",  4); break;
-        case LEPT_NUMBER: c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", v->u.n); break;
-        case LEPT_STRING: lept_stringify_string(c, v->u.s.s, v->u.s.len); break;
+        case LEPT_NULL:   PUTS(c, "null",  4); return 0;
+        case LEPT_FALSE:  PUTS(c, "false", 5); return 0;
+        case LEPT_TRUE:   PUTS(c, "true",  4); return 0;
+        case LEPT_NUMBER: lept_stringify_number(c, v->u.n); return 0;
+        case LEPT_INTEGER: lept_stringify_int64(c, v->u.i); return 0;
+        case LEPT_STRING: lept_stringify_string(c, LEPT_STRING_CHARS(v), LEPT_STRING_LENGTH(v)); return 0;
         case LEPT_ARRAY:
             PUTC(c, '[');
-            for (i = 0; i < v->u.a.size; i++) {
-                if (i > 0)
-                    PUTC(c, ',');
-                lept_stringify_value(c, &v->u.a.e[i]);
-            }
+            if (v->u.a.size > 0)
+                return 1;
             PUTC(c, ']');
-            break;
+            return 0;
         case LEPT_OBJECT:
             PUTC(c, '{');
-            for (i = 0; i < v->u.o.size; i++) {
-                if (i > 0)
-                    PUTC(c, ',');
-                lept_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
-                PUTC(c, ':');
-                lept_stringify_value(c, &v->u.o.m[i].v);
-            }
+            if (v->u.o.size > 0)
+                return 1;
             PUTC(c, '}');
-            break;
-        default: assert(0 && "invalid type");
+            return 0;
+        default: assert(0 && "invalid type"); return 0;
     }
 }
 
+static void lept_stringify_value(lept_context* c, const lept_value* v) {
+    lept_context s;
+    lept_stringify_frame* f;
+    if (!lept_stringify_node(c, v))
+        return;
+    s.allocator = c->allocator;
+    s.stack = NULL;
+    s.size = s.top = 0;
+    f = (lept_stringify_frame*)lept_context_push(&s, sizeof(lept_stringify_frame));
+    f->v = v;
+    f->i = 0;
+    while (s.top > 0) {
+        f = (lept_stringify_frame*)(s.stack + s.top - sizeof(lept_stringify_frame));
+        if (f->v->type == LEPT_ARRAY) {
+            if (f->i == f->v->u.a.size) {
+                PUTC(c, ']');
+                lept_context_pop(&s, sizeof(lept_stringify_frame));
+                continue;
+            }
+            if (f->i > 0)
+                PUTC(c, ',');
+            v = &f->v->u.a.e[f->i++];
+        }
+        else {
+            const lept_member* m;
+            if (f->i == f->v->u.o.size) {
+                PUTC(c, '}');
+                lept_context_pop(&s, sizeof(lept_stringify_frame));
+                continue;
+            }
+            if (f->i > 0)
+                PUTC(c, ',');
+            m = &f->v->u.o.m[f->i++];
+            lept_stringify_string(c, m->k, m->klen);
+            PUTC(c, ':');
+            v = &m->v;
+        }
+        if (lept_stringify_node(c, v)) {
+            f = (lept_stringify_frame*)lept_context_push(&s, sizeof(lept_stringify_frame));
+            f->v = v;
+            f->i = 0;
+        }
+    }
+    LEPT_DEALLOC(s.allocator, s.stack);
+}
+
 char* lept_stringify(const lept_value* v, size_t* length) {
     lept_context c;
     assert(v != NULL);
-    c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
+    c.allocator = lept_global_allocator;
+    c.stack = (char*)LEPT_ALLOC(c.allocator, c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
     c.top = 0;
     lept_stringify_value(&c, v);
     if (length)
@@ -415,23 +3219,96 @@ char* lept_stringify(const lept_value* v, size_t* length) {
     return c.stack;
 }
 
-void lept_copy(lept_value* dst, const lept_value* src) {
-    assert(src != NULL && dst != NULL && src != dst);
+const char* lept_parser_stringify(lept_parser* parser, const lept_value* v, size_t* length) {
+    lept_context c;
+    assert(parser != NULL && v != NULL);
+    lept_context_acquire(&c, parser);
+    lept_stringify_value(&c, v);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    lept_context_release(&c, parser);
+    return parser->stack;
+}
+
+/* Containers are copied without recursion, with a stack of those still being filled. */
+
+typedef struct {
+    lept_value* dst;
+    const lept_value* src;
+}lept_copy_frame;
+
+/* Copies src into the uninitialized dst, except for elements and members, returning whether there are some. */
+static int lept_copy_node(lept_value* dst, const lept_value* src) {
+    lept_init(dst);
+    if (LEPT_OWNS_STORAGE(src))
+        LEPT_EXPAND(src);
     switch (src->type) {
         case LEPT_STRING:
-            lept_set_string(dst, src->u.s.s, src->u.s.len);
-            break;
+            lept_set_string(dst, LEPT_STRING_CHARS(src), LEPT_STRING_LENGTH(src));
+            return 0;
         case LEPT_ARRAY:
-            /* \todo */
-            break;
+            lept_set_array(dst, src->u.a.size);
+            if (src->flags & LEPT_FLAG_SCALARS) {
+                if (src->u.a.size > 0)
+                    memcpy(dst->u.a.e, src->u.a.e, src->u.a.size * sizeof(lept_value));
+                dst->u.a.size = src->u.a.size;
+                dst->flags |= LEPT_FLAG_SCALARS;
+            }
+            return dst->u.a.size < src->u.a.size;
         case LEPT_OBJECT:
-            /* \todo */
-            break;
+            lept_set_object(dst, src->u.o.size);
+            return src->u.o.size > 0;
         default:
-            lept_free(dst);
             memcpy(dst, src, sizeof(lept_value));
-            break;
+            dst->flags = 0;
+            return 0;
+    }
+}
+
+void lept_copy(lept_value* dst, const lept_value* src) {
+    lept_context c;
+    lept_copy_frame f;
+    assert(src != NULL && dst != NULL && src != dst);
+    lept_free(dst);
+    if (!lept_copy_node(dst, src))
+        return;
+    c.allocator = lept_global_allocator;
+    c.stack = NULL;
+    c.size = c.top = 0;
+    f.dst = dst;
+    f.src = src;
+    memcpy(lept_context_push(&c, sizeof(lept_copy_frame)), &f, sizeof(lept_copy_frame));
+    while (c.top > 0) {
+        memcpy(&f, c.stack + c.top - sizeof(lept_copy_frame), sizeof(lept_copy_frame));
+        if (f.src->type == LEPT_ARRAY) {
+            size_t i = f.dst->u.a.size;
+            if (i == f.src->u.a.size) {
+                lept_context_pop(&c, sizeof(lept_copy_frame));
+                continue;
+            }
+            f.dst->u.a.size++;
+            f.dst = &f.dst->u.a.e[i];
+            f.src = &f.src->u.a.e[i];
+        }
+        else {
+            size_t i = f.dst->u.o.size;
+            lept_member* m = &f.dst->u.o.m[i];
+            if (i == f.src->u.o.size) {
+                lept_context_pop(&c, sizeof(lept_copy_frame));
+                continue;
+            }
+            memcpy(m->k = (char*)lept_malloc(NULL, f.src->u.o.m[i].klen + 1), f.src->u.o.m[i].k, f.src->u.o.m[i].klen + 1);
+            m->klen = f.src->u.o.m[i].klen;
+            lept_index_add(f.dst, f.dst->u.o.size++);
+            f.dst = &m->v;
+            f.src = &f.src->u.o.m[i].v;
+        }
+        if (lept_copy_node(f.dst, f.src))
+            memcpy(lept_context_push(&c, sizeof(lept_copy_frame)), &f, sizeof(lept_copy_frame));
     }
+    if (c.stack != NULL)
+        LEPT_DEALLOC(c.allocator, c.stack);
 }
 
 void lept_move(lept_value* dst, lept_value* src) {
@@ -451,28 +3328,96 @@ void lept_swap(lept_value* lhs, lept_value* rhs) {
     }
 }
 
+/*
+ * Values are released without recursion or extra memory: the first element of a container that is a
+ * container itself takes its place, and the first slot, released by then, links the container into a list
+ * of those still to release, with the index of the next element to release in place of the capacity.
+ */
+
+#define LEPT_IS_LEAF(v) (!((v)->type == LEPT_ARRAY || (v)->type == LEPT_OBJECT) || ((v)->flags & LEPT_FLAG_ARENA) ||\
+    ((v)->type == LEPT_ARRAY ? (v)->u.a.size == 0 || ((v)->flags & LEPT_FLAG_SCALARS) : (v)->u.o.size == 0))
+
+/* Releases a value whose storage holds nothing to release. */
+static void lept_release_leaf(lept_value* v) {
+    if (v->flags & LEPT_FLAG_ARENA)
+        return;
+    switch (v->type) {
+        case LEPT_STRING: if (!(v->flags & (LEPT_FLAG_BORROWED | LEPT_FLAG_INLINE))) lept_dealloc(NULL, v->u.s.s); break;
+        case LEPT_ARRAY:  lept_store_free(v->u.a.e); break;
+        case LEPT_OBJECT: lept_store_free(v->u.o.m); break;
+        default: break;
+    }
+}
+
+/* Releases the leading leaves of v, then v is replaced by its first other element, repeatedly. */
+static void lept_release(lept_value* v, lept_value** pending) {
+    lept_value* node, temp;
+    size_t i;
+    while (!LEPT_IS_LEAF(v)) {
+        if (v->type == LEPT_ARRAY) {
+            node = v->u.a.e;
+            for (i = 0; i < v->u.a.size && LEPT_IS_LEAF(&node[i]); i++)
+                lept_release_leaf(&node[i]);
+            if (i == v->u.a.size) {
+                lept_store_free(node);
+                return;
+            }
+            memcpy(&temp, &node[i], sizeof(lept_value));
+        }
+        else {
+            lept_member* m = v->u.o.m;
+            for (i = 0; i < v->u.o.size; i++) {
+                if (!(v->flags & LEPT_FLAG_BORROWED))
+                    lept_dealloc(NULL, m[i].k);
+                if (!LEPT_IS_LEAF(&m[i].v))
+                    break;
+                lept_release_leaf(&m[i].v);
+            }
+            if (i == v->u.o.size) {
+                lept_store_free(m);
+                return;
+            }
+            memcpy(&temp, &m[i].v, sizeof(lept_value));
+            node = &m[0].v;
+        }
+        /* the first slot is free now, the link replaces the storage pointer, which is node itself */
+        memcpy(node, v, sizeof(lept_value));
+        node->u.a.e = *pending;
+        LEPT_NEXT_INDEX(node) = i + 1;
+        *pending = node;
+        memcpy(v, &temp, sizeof(lept_value));
+    }
+    lept_release_leaf(v);
+}
+
 void lept_free(lept_value* v) {
+    lept_value* pending = NULL, *node;
     size_t i;
     assert(v != NULL);
-    switch (v->type) {
-        case LEPT_STRING:
-            free(v->u.s.s);
-            break;
-        case LEPT_ARRAY:
-            for (i = 0; i < v->u.a.size; i++)
-                lept_free(&v->u.a.e[i]);
-            free(v->u.a.e);
-            break;
-        case LEPT_OBJECT:
-            for (i = 0; i < v->u.o.size; i++) {
-                free(v->u.o.m[i].k);
-                lept_free(&v->u.o.m[i].v);
+    lept_release(v, &pending);
+    while ((node = pending) != NULL) {
+        /* depth first, so that containers are released while their memory is likely cached */
+        if (node->type == LEPT_ARRAY) {
+            if ((i = LEPT_NEXT_INDEX(node)++) < node->u.a.size) {
+                lept_release(&node[i], &pending);
+                continue;
             }
-            free(v->u.o.m);
-            break;
-        default: break;
+            pending = node->u.a.e;
+            lept_store_free(node);
+        }
+        else {
+            lept_member* m = (lept_member*)((char*)node - offsetof(lept_member, v));
+            if ((i = LEPT_NEXT_INDEX(node)++) < node->u.o.size) {
+                if (!(node->flags & LEPT_FLAG_BORROWED))
+                    lept_dealloc(NULL, m[i].k);
+                lept_release(&m[i].v, &pending);
+                continue;
+            }
+            pending = node->u.a.e;
+            lept_store_free(m);
+        }
     }
-    v->type = LEPT_NULL;
+    lept_init(v);
 }
 
 lept_type lept_get_type(const lept_value* v) {
@@ -480,32 +3425,110 @@ lept_type lept_get_type(const lept_value* v) {
     return v->type;
 }
 
-int lept_is_equal(const lept_value* lhs, const lept_value* rhs) {
+/* Compares two values, except for elements and members: 0 if they differ, 2 if those remain to compare. */
+static int lept_equal_node(const lept_value* lhs, const lept_value* rhs) {
     size_t i;
-    assert(lhs != NULL && rhs != NULL);
+    if (lhs->type == LEPT_INTEGER && rhs->type == LEPT_NUMBER)
+        return lept_equal_node(rhs, lhs);
+    if (lhs->type == LEPT_NUMBER && rhs->type == LEPT_INTEGER)  /* exact: the double must round-trip to the same integer */
+        return lhs->u.n == (double)rhs->u.i && lhs->u.n >= -9223372036854775808.0 && lhs->u.n < 9223372036854775808.0 &&
+            (int64_t)lhs->u.n == rhs->u.i;
     if (lhs->type != rhs->type)
         return 0;
+    if (LEPT_OWNS_STORAGE(lhs)) {
+        LEPT_EXPAND(lhs);
+        LEPT_EXPAND(rhs);
+    }
     switch (lhs->type) {
         case LEPT_STRING:
-            return lhs->u.s.len == rhs->u.s.len && 
-                memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
+            return LEPT_STRING_LENGTH(lhs) == LEPT_STRING_LENGTH(rhs) &&
+                memcmp(LEPT_STRING_CHARS(lhs), LEPT_STRING_CHARS(rhs), LEPT_STRING_LENGTH(lhs)) == 0;
         case LEPT_NUMBER:
             return lhs->u.n == rhs->u.n;
+        case LEPT_INTEGER:
+            return lhs->u.i == rhs->u.i;
         case LEPT_ARRAY:
             if (lhs->u.a.size != rhs->u.a.size)
                 return 0;
+            if (!(lhs->flags & rhs->flags & LEPT_FLAG_SCALARS))
+                return lhs->u.a.size > 0 ? 2 : 1;
             for (i = 0; i < lhs->u.a.size; i++)
-                if (!lept_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
+                if (!lept_equal_node(&lhs->u.a.e[i], &rhs->u.a.e[i]))
                     return 0;
             return 1;
         case LEPT_OBJECT:
-            /* \todo */
-            return 1;
+            if (lhs->u.o.size != rhs->u.o.size)
+                return 0;
+            return lhs->u.o.size > 0 ? 2 : 1;
         default:
             return 1;
     }
 }
 
+typedef struct {
+    const lept_value* lhs, *rhs;
+    size_t index;   /* of the next element or member to compare */
+}lept_equal_frame;
+
+/* Finds the member of rhs to compare with member i of lhs: the same occurrence of the same key. */
+static size_t lept_equal_member(const lept_value* lhs, size_t i, const lept_value* rhs) {
+    const lept_member* m = &lhs->u.o.m[i];
+    size_t j, n = 0;
+    if (lept_find_object_index(lhs, m->k, m->klen) == i)
+        return lept_find_object_index(rhs, m->k, m->klen);
+    for (j = 0; j < i; j++)
+        if (lhs->u.o.m[j].klen == m->klen && memcmp(lhs->u.o.m[j].k, m->k, m->klen) == 0)
+            n++;
+    for (j = 0; j < rhs->u.o.size; j++)
+        if (rhs->u.o.m[j].klen == m->klen && memcmp(rhs->u.o.m[j].k, m->k, m->klen) == 0 && n-- == 0)
+            return j;
+    return LEPT_KEY_NOT_EXIST;
+}
+
+int lept_is_equal(const lept_value* lhs, const lept_value* rhs) {
+    lept_context c;
+    lept_equal_frame f;
+    int ret;
+    assert(lhs != NULL && rhs != NULL);
+    if ((ret = lept_equal_node(lhs, rhs)) != 2)
+        return ret;
+    c.allocator = lept_global_allocator;
+    c.stack = NULL;
+    c.size = c.top = 0;
+    f.lhs = lhs;
+    f.rhs = rhs;
+    f.index = 0;
+    memcpy(lept_context_push(&c, sizeof(lept_equal_frame)), &f, sizeof(lept_equal_frame));
+    while (ret != 0 && c.top > 0) {
+        lept_equal_frame* top = (lept_equal_frame*)(c.stack + c.top - sizeof(lept_equal_frame));
+        size_t i = top->index++;
+        if (i == (top->lhs->type == LEPT_ARRAY ? top->lhs->u.a.size : top->lhs->u.o.size)) {
+            lept_context_pop(&c, sizeof(lept_equal_frame));
+            continue;
+        }
+        if (top->lhs->type == LEPT_ARRAY) {
+            f.lhs = &top->lhs->u.a.e[i];
+            f.rhs = &top->rhs->u.a.e[i];
+        }
+        else {
+            size_t j = lept_equal_member(top->lhs, i, top->rhs);
+            if (j == LEPT_KEY_NOT_EXIST) {
+                ret = 0;
+                break;
+            }
+            f.lhs = &top->lhs->u.o.m[i].v;
+            f.rhs = &top->rhs->u.o.m[j].v;
+        }
+        if ((ret = lept_equal_node(f.lhs, f.rhs)) == 2) {
+            f.index = 0;
+            memcpy(lept_context_push(&c, sizeof(lept_equal_frame)), &f, sizeof(lept_equal_frame));
+        }
+    }
+    if (c.stack != NULL)
+        LEPT_DEALLOC(c.allocator, c.stack);
+    return ret != 0;
+}
+
 int lept_get_boolean(const lept_value* v) {
     assert(v != NULL && (v->type == LEPT_TRUE || v->type == LEPT_FALSE));
     return v->type == LEPT_TRUE;
@@ -514,72 +3537,167 @@ int lept_get_boolean(const lept_value* v) {
 void lept_set_boolean(lept_value* v, int b) {
     lept_free(v);
     v->type = b ? LEPT_TRUE : LEPT_FALSE;
+    v->flags = 0;
 }
 
 double lept_get_number(const lept_value* v) {
-    assert(v != NULL && v->type == LEPT_NUMBER);
-    return v->u.n;
+    assert(v != NULL && (v->type == LEPT_NUMBER || v->type == LEPT_INTEGER));
+    return v->type == LEPT_INTEGER ? (double)v->u.i : v->u.n;
 }
 
 void lept_set_number(lept_value* v, double n) {
     lept_free(v);
     v->u.n = n;
     v->type = LEPT_NUMBER;
+    v->flags = 0;
+}
+
+int64_t lept_get_int64(const lept_value* v) {
+    assert(v != NULL && v->type == LEPT_INTEGER);
+    return v->u.i;
+}
+
+void lept_set_int64(lept_value* v, int64_t i) {
+    lept_free(v);
+    v->u.i = i;
+    v->type = LEPT_INTEGER;
+    v->flags = 0;
 }
 
 const char* lept_get_string(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_STRING);
-    return v->u.s.s;
+    LEPT_EXPAND(v);
+    return LEPT_STRING_CHARS(v);
 }
 
 size_t lept_get_string_length(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_STRING);
-    return v->u.s.len;
+    LEPT_EXPAND(v);
+    return LEPT_STRING_LENGTH(v);
 }
 
-void lept_set_string(lept_value* v, const char* s, size_t len) {
-    assert(v != NULL && (s != NULL || len == 0));
+/* Short strings are kept in the value, the others in storage of their own. */
+static void lept_set_string_in(lept_document* d, lept_value* v, const char* s, size_t len) {
+    char* p;
+    assert(v != NULL && (s != NULL || len == 0) && len <= LEPT_SIZE_MAX);
     lept_free(v);
-    v->u.s.s = (char*)malloc(len + 1);
-    memcpy(v->u.s.s, s, len);
-    v->u.s.s[len] = '\0';
-    v->u.s.len = len;
     v->type = LEPT_STRING;
+    v->flags = LEPT_STORAGE(d);
+    if (len <= LEPT_INLINE_MAX) {
+        p = v->u.c;
+        v->u.c[LEPT_INLINE_MAX + 1] = (char)len;
+        v->flags |= LEPT_FLAG_INLINE;
+    }
+    else {
+        p = v->u.s.s = (char*)lept_malloc(d, len + 1);
+        v->u.s.len = len;
+    }
+    memcpy(p, s, len);
+    p[len] = '\0';
 }
 
-void lept_set_array(lept_value* v, size_t capacity) {
+void lept_set_string(lept_value* v, const char* s, size_t len) {
+    lept_set_string_in(NULL, v, s, len);
+}
+
+/* v->u.a.e must be NULL, or elements of v, as must v->u.o.m be for members below. */
+static void lept_resize_elements(lept_document* d, lept_value* v, size_t capacity) {
+    assert(capacity <= LEPT_SIZE_MAX);
+    v->u.a.e = (lept_value*)lept_store_resize(d, v->u.a.e, capacity, LEPT_ARRAY_CAPACITY(v) * sizeof(lept_value), capacity * sizeof(lept_value));
+#ifndef LEPT_COMPACT
+    v->u.a.capacity = capacity;
+#endif
+}
+
+/*
+ * Large objects keep room for a hash index after their members, so that lookups need not move the members. The index
+ * is built wherever members are stored and kept up to date as they are added, so lookups only read it.
+ */
+static size_t lept_index_slots(size_t capacity) {
+    size_t n;
+    if (capacity < LEPT_OBJECT_INDEX_MIN || capacity > UINT32_MAX / 2)
+        return 0;
+    for (n = 64; n < capacity * 2; n *= 2)
+        ;
+    return n;
+}
+
+#define LEPT_MEMBERS_SIZE(capacity) ((capacity) * sizeof(lept_member) + lept_index_slots(capacity) * sizeof(uint32_t))
+#define LEPT_INDEX(v)       ((uint32_t*)((v)->u.o.m + LEPT_OBJECT_CAPACITY(v))) /* member indices from 1, 0 if free */
+
+/* Members with the same key are added in order, so probing meets the first of them first, as a scan would. */
+static void lept_index_add(lept_value* v, size_t index) {
+    uint32_t* slots;
+    size_t mask = lept_index_slots(LEPT_OBJECT_CAPACITY(v)), j;
+    if (mask-- == 0)
+        return;
+    slots = LEPT_INDEX(v);
+    for (j = lept_hash(v->u.o.m[index].k, v->u.o.m[index].klen) & mask; slots[j] != 0; j = (j + 1) & mask)
+        ;
+    slots[j] = (uint32_t)(index + 1);
+}
+
+/* Indexes all members of v again, after they are stored or moved. */
+static void lept_index_build(lept_value* v) {
+    size_t i, n = lept_index_slots(LEPT_OBJECT_CAPACITY(v));
+    if (n == 0)
+        return;
+    memset(LEPT_INDEX(v), 0, n * sizeof(uint32_t));
+    for (i = 0; i < v->u.o.size; i++)
+        lept_index_add(v, i);
+}
+
+static void lept_resize_members(lept_document* d, lept_value* v, size_t capacity) {
+    assert(capacity <= LEPT_SIZE_MAX);
+    v->u.o.m = (lept_member*)lept_store_resize(d, v->u.o.m, capacity, LEPT_MEMBERS_SIZE(LEPT_OBJECT_CAPACITY(v)), LEPT_MEMBERS_SIZE(capacity));
+#ifndef LEPT_COMPACT
+    v->u.o.capacity = capacity;
+#endif
+    lept_index_build(v);
+}
+
+static void lept_set_array_in(lept_document* d, lept_value* v, size_t capacity) {
     assert(v != NULL);
     lept_free(v);
     v->type = LEPT_ARRAY;
+    v->flags = LEPT_STORAGE(d);
     v->u.a.size = 0;
-    v->u.a.capacity = capacity;
-    v->u.a.e = capacity > 0 ? (lept_value*)malloc(capacity * sizeof(lept_value)) : NULL;
+    v->u.a.e = NULL;
+    lept_resize_elements(d, v, capacity);
+}
+
+void lept_set_array(lept_value* v, size_t capacity) {
+    lept_set_array_in(NULL, v, capacity);
 }
 
 size_t lept_get_array_size(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_ARRAY);
+    LEPT_EXPAND(v);
     return v->u.a.size;
 }
 
 size_t lept_get_array_capacity(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    return v->u.a.capacity;
+    LEPT_EXPAND(v);
+    return LEPT_ARRAY_CAPACITY(v);
 }
 
-void lept_reserve_array(lept_value* v, size_t capacity) {
+static void lept_reserve_array_in(lept_document* d, lept_value* v, size_t capacity) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    if (v->u.a.capacity < capacity) {
-        v->u.a.capacity = capacity;
-        v->u.a.e = (lept_value*)realloc(v->u.a.e, capacity * sizeof(lept_value));
-    }
+    LEPT_EXPAND(v);
+    LEPT_CHECK_STORAGE(d, v);
+    if (LEPT_ARRAY_CAPACITY(v) < capacity)
+        lept_resize_elements(d, v, capacity);
+}
+
+void lept_reserve_array(lept_value* v, size_t capacity) {
+    lept_reserve_array_in(NULL, v, capacity);
 }
 
 void lept_shrink_array(lept_value* v) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    if (v->u.a.capacity > v->u.a.size) {
-        v->u.a.capacity = v->u.a.size;
-        v->u.a.e = (lept_value*)realloc(v->u.a.e, v->u.a.capacity * sizeof(lept_value));
-    }
+    if (LEPT_ARRAY_CAPACITY(v) > v->u.a.size && !(v->flags & LEPT_FLAG_ARENA))
+        lept_resize_elements(NULL, v, v->u.a.size);
 }
 
 void lept_clear_array(lept_value* v) {
@@ -589,93 +3707,147 @@ void lept_clear_array(lept_value* v) {
 
 lept_value* lept_get_array_element(lept_value* v, size_t index) {
     assert(v != NULL && v->type == LEPT_ARRAY);
+    LEPT_EXPAND(v);
     assert(index < v->u.a.size);
+    v->flags &= ~LEPT_FLAG_SCALARS;
     return &v->u.a.e[index];
 }
 
-lept_value* lept_pushback_array_element(lept_value* v) {
+static lept_value* lept_pushback_array_element_in(lept_document* d, lept_value* v) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    if (v->u.a.size == v->u.a.capacity)
-        lept_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
+    LEPT_EXPAND(v);
+    assert(v->u.a.size < LEPT_SIZE_MAX);
+    if (v->u.a.size == LEPT_ARRAY_CAPACITY(v))
+        lept_reserve_array_in(d, v, LEPT_GROW(LEPT_ARRAY_CAPACITY(v)));
     lept_init(&v->u.a.e[v->u.a.size]);
+    v->flags &= ~LEPT_FLAG_SCALARS;
     return &v->u.a.e[v->u.a.size++];
 }
 
+lept_value* lept_pushback_array_element(lept_value* v) {
+    return lept_pushback_array_element_in(NULL, v);
+}
+
 void lept_popback_array_element(lept_value* v) {
-    assert(v != NULL && v->type == LEPT_ARRAY && v->u.a.size > 0);
+    assert(v != NULL && v->type == LEPT_ARRAY);
+    LEPT_EXPAND(v);
+    assert(v->u.a.size > 0);
     lept_free(&v->u.a.e[--v->u.a.size]);
 }
 
+static lept_value* lept_insert_array_element_in(lept_document* d, lept_value* v, size_t index) {
+    assert(v != NULL && v->type == LEPT_ARRAY);
+    LEPT_EXPAND(v);
+    assert(index <= v->u.a.size);
+    assert(v->u.a.size < LEPT_SIZE_MAX);
+    if (v->u.a.size == LEPT_ARRAY_CAPACITY(v))
+        lept_reserve_array_in(d, v, LEPT_GROW(LEPT_ARRAY_CAPACITY(v)));
+    memmove(&v->u.a.e[index + 1], &v->u.a.e[index], (v->u.a.size - index) * sizeof(lept_value));
+    v->u.a.size++;
+    lept_init(&v->u.a.e[index]);
+    v->flags &= ~LEPT_FLAG_SCALARS;
+    return &v->u.a.e[index];
+}
+
 lept_value* lept_insert_array_element(lept_value* v, size_t index) {
-    assert(v != NULL && v->type == LEPT_ARRAY && index <= v->u.a.size);
-    /* \todo */
-    return NULL;
+    return lept_insert_array_element_in(NULL, v, index);
 }
 
 void lept_erase_array_element(lept_value* v, size_t index, size_t count) {
-    assert(v != NULL && v->type == LEPT_ARRAY && index + count <= v->u.a.size);
+    assert(v != NULL && v->type == LEPT_ARRAY);
+    LEPT_EXPAND(v);
+    assert(index + count <= v->u.a.size);
     /* \todo */
 }
 
-void lept_set_object(lept_value* v, size_t capacity) {
+static void lept_set_object_in(lept_document* d, lept_value* v, size_t capacity) {
     assert(v != NULL);
     lept_free(v);
     v->type = LEPT_OBJECT;
+    v->flags = LEPT_STORAGE(d);
     v->u.o.size = 0;
-    v->u.o.capacity = capacity;
-    v->u.o.m = capacity > 0 ? (lept_member*)malloc(capacity * sizeof(lept_member)) : NULL;
+    v->u.o.m = NULL;
+    lept_resize_members(d, v, capacity);
+}
+
+void lept_set_object(lept_value* v, size_t capacity) {
+    lept_set_object_in(NULL, v, capacity);
 }
 
 size_t lept_get_object_size(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
     return v->u.o.size;
 }
 
 size_t lept_get_object_capacity(const lept_value* v) {
     assert(v != NULL && v->type == LEPT_OBJECT);
-    /* \todo */
-    return 0;
+    LEPT_EXPAND(v);
+    return LEPT_OBJECT_CAPACITY(v);
 }
 
-void lept_reserve_object(lept_value* v, size_t capacity) {
+static void lept_reserve_object_in(lept_document* d, lept_value* v, size_t capacity) {
     assert(v != NULL && v->type == LEPT_OBJECT);
-    /* \todo */
+    LEPT_EXPAND(v);
+    LEPT_CHECK_STORAGE(d, v);
+    if (LEPT_OBJECT_CAPACITY(v) < capacity)
+        lept_resize_members(d, v, capacity);
+}
+
+void lept_reserve_object(lept_value* v, size_t capacity) {
+    lept_reserve_object_in(NULL, v, capacity);
 }
 
 void lept_shrink_object(lept_value* v) {
     assert(v != NULL && v->type == LEPT_OBJECT);
-    /* \todo */
+    if (LEPT_OBJECT_CAPACITY(v) > v->u.o.size && !(v->flags & LEPT_FLAG_ARENA))
+        lept_resize_members(NULL, v, v->u.o.size);
 }
 
 void lept_clear_object(lept_value* v) {
     assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
     /* \todo */
 }
 
 const char* lept_get_object_key(const lept_value* v, size_t index) {
     assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
     assert(index < v->u.o.size);
     return v->u.o.m[index].k;
 }
 
 size_t lept_get_object_key_length(const lept_value* v, size_t index) {
     assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
     assert(index < v->u.o.size);
     return v->u.o.m[index].klen;
 }
 
 lept_value* lept_get_object_value(lept_value* v, size_t index) {
     assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
     assert(index < v->u.o.size);
     return &v->u.o.m[index].v;
 }
 
 size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen) {
-    size_t i;
+    const lept_member* m;
+    const uint32_t* slots;
+    size_t i, j, mask;
     assert(v != NULL && v->type == LEPT_OBJECT && key != NULL);
-    for (i = 0; i < v->u.o.size; i++)
-        if (v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0)
-            return i;
+    LEPT_EXPAND(v);
+    m = v->u.o.m;
+    if ((mask = lept_index_slots(LEPT_OBJECT_CAPACITY(v))) == 0) {
+        for (i = 0; i < v->u.o.size; i++)
+            if (m[i].klen == klen && (m[i].k == key || memcmp(m[i].k, key, klen) == 0))
+                return i;
+        return LEPT_KEY_NOT_EXIST;
+    }
+    slots = LEPT_INDEX(v);
+    for (j = lept_hash(key, klen) & --mask; (i = slots[j]) != 0; j = (j + 1) & mask)
+        if (m[i - 1].klen == klen && (m[i - 1].k == key || memcmp(m[i - 1].k, key, klen) == 0))
+            return i - 1;
     return LEPT_KEY_NOT_EXIST;
 }
 
@@ -684,13 +3856,76 @@ lept_value* lept_find_object_value(lept_value* v, const char* key, size_t klen)
     return index != LEPT_KEY_NOT_EXIST ? &v->u.o.m[index].v : NULL;
 }
 
-lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen) {
+static lept_value* lept_set_object_value_in(lept_document* d, lept_value* v, const char* key, size_t klen) {
+    size_t i;
+    lept_member* m;
     assert(v != NULL && v->type == LEPT_OBJECT && key != NULL);
-    /* \todo */
-    return NULL;
+    if ((i = lept_find_object_index(v, key, klen)) != LEPT_KEY_NOT_EXIST)
+        return &v->u.o.m[i].v;
+    if (v->flags & LEPT_FLAG_BORROWED) {
+        /* keys are owned all or none, so take ownership of the borrowed ones before adding an owned key */
+        for (i = 0; i < v->u.o.size; i++)
+            v->u.o.m[i].k = lept_copy_key(d, v->u.o.m[i].k, v->u.o.m[i].klen);
+        v->flags &= ~LEPT_FLAG_BORROWED;
+    }
+    assert(v->u.o.size < LEPT_SIZE_MAX);
+    if (v->u.o.size == LEPT_OBJECT_CAPACITY(v))
+        lept_reserve_object_in(d, v, LEPT_GROW(LEPT_OBJECT_CAPACITY(v)));
+    m = &v->u.o.m[v->u.o.size++];
+    m->k = lept_copy_key(d, key, klen);
+    m->klen = klen;
+    lept_init(&m->v);
+    lept_index_add(v, v->u.o.size - 1);
+    return &m->v;
+}
+
+lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen) {
+    return lept_set_object_value_in(NULL, v, key, klen);
 }
 
 void lept_remove_object_value(lept_value* v, size_t index) {
-    assert(v != NULL && v->type == LEPT_OBJECT && index < v->u.o.size);
+    assert(v != NULL && v->type == LEPT_OBJECT);
+    LEPT_EXPAND(v);
+    assert(index < v->u.o.size);
     /* \todo */
 }
+
+void lept_document_set_string(lept_document* d, lept_value* v, const char* s, size_t len) {
+    assert(d != NULL);
+    lept_set_string_in(d, v, s, len);
+}
+
+void lept_document_set_array(lept_document* d, lept_value* v, size_t capacity) {
+    assert(d != NULL);
+    lept_set_array_in(d, v, capacity);
+}
+
+void lept_document_reserve_array(lept_document* d, lept_value* v, size_t capacity) {
+    assert(d != NULL);
+    lept_reserve_array_in(d, v, capacity);
+}
+
+lept_value* lept_document_pushback_array_element(lept_document* d, lept_value* v) {
+    assert(d != NULL);
+    return lept_pushback_array_element_in(d, v);
+}
+
+lept_value* lept_document_insert_array_element(lept_document* d, lept_value* v, size_t index) {
+    assert(d != NULL);
+    return lept_insert_array_element_in(d, v, index);
+}
+
+void lept_document_set_object(lept_document* d, lept_value* v, size_t capacity) {
+    assert(d != NULL);
+    lept_set_object_in(d, v, capacity);
+}
+
+void lept_document_reserve_object(lept_document* d, lept_value* v, size_t capacity) {
+    assert(d != NULL);
+    lept_reserve_object_in(d, v, capacity);
+}
+
+lept_value* lept_document_set_object_value(lept_document* d, lept_value* v, const char* key, size_t klen) {
+    assert(d != NULL);
+    return lept_set_object_value_in(d, v, key, klen);
+}
@@ -2,23 +2,53 @@
 #define LEPTJSON_H__
 
 #include <stddef.h> /* size_t */
+#include <stdint.h> /* int64_t */
 
-typedef enum { LEPT_NULL, LEPT_FALSE, LEPT_TRUE, LEPT_NUMBER, LEPT_STRING, LEPT_ARRAY, LEPT_OBJECT } lept_type;
+typedef enum { LEPT_NULL, LEPT_FALSE, LEPT_TRUE, LEPT_NUMBER, LEPT_STRING, LEPT_ARRAY, LEPT_OBJECT, LEPT_INTEGER } lept_type;
 
 #define LEPT_KEY_NOT_EXIST ((size_t)-1)
 
 typedef struct lept_value lept_value;
 typedef struct lept_member lept_member;
+typedef struct lept_document lept_document;
 
+#ifdef LEPT_COMPACT
+/*
+ * Defining LEPT_COMPACT, for the library and its users alike, makes values 16 bytes on 64-bit targets:
+ * counts and lengths are 32-bit, and capacities are kept before the elements/members. Parsing longer strings or
+ * larger containers fails with LEPT_PARSE_SIZE_EXCEEDED, and setting them fails an assertion.
+ */
+struct lept_lazy;
+#pragma pack(push, 4)
+struct lept_value {
+    union {
+        struct { lept_member* m; uint32_t size; }o;         /* object: members, member count */
+        struct { lept_value*  e; uint32_t size; }a;         /* array:  elements, element count */
+        struct { char* s; uint32_t len; }s;                 /* string: null-terminated string, string length */
+        double n;                                           /* number */
+        int64_t i;                                          /* integer: number without fraction or exponent */
+        struct lept_lazy* l;                                /* internal: text of a lazily parsed value, in its document */
+        char c[sizeof(char*) + sizeof(uint32_t)];           /* internal: short string, its length in the last byte */
+    }u;
+    unsigned char type;
+    unsigned char flags;                                    /* internal: ownership of string/key storage */
+};
+#pragma pack(pop)
+#else
 struct lept_value {
     union {
         struct { lept_member* m; size_t size, capacity; }o; /* object: members, member count, capacity */
         struct { lept_value*  e; size_t size, capacity; }a; /* array:  elements, element count, capacity */
         struct { char* s; size_t len; }s;                   /* string: null-terminated string, string length */
         double n;                                           /* number */
+        int64_t i;                                          /* integer: number without fraction or exponent */
+        struct lept_lazy { const char* json; size_t len; lept_document* d; }l; /* internal: text of a lazily parsed value */
+        char c[3 * sizeof(size_t)];                         /* internal: short string, its length in the last byte */
     }u;
     lept_type type;
+    unsigned flags;                                         /* internal: ownership of string/key storage */
 };
+#endif
 
 struct lept_member {
     char* k; size_t klen;   /* member key string, key string length */
@@ -39,14 +69,214 @@ enum {
     LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     LEPT_PARSE_MISS_KEY,
     LEPT_PARSE_MISS_COLON,
-    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    LEPT_PARSE_ABORTED,
+    LEPT_PARSE_DEPTH_EXCEEDED,
+    LEPT_PARSE_FILE_ERROR,      /* the file could not be opened or mapped, errno tells why */
+    LEPT_PARSE_SIZE_EXCEEDED    /* a string or container is longer than values can hold, see LEPT_COMPACT */
 };
 
-#define lept_init(v) do { (v)->type = LEPT_NULL; } while(0)
+/* Each callback may be NULL to ignore the event, and returns 0 to abort the parse with LEPT_PARSE_ABORTED */
+typedef struct {
+    int (*null)(void* ctx);
+    int (*boolean)(void* ctx, int b);
+    int (*number)(void* ctx, double n);
+    int (*integer)(void* ctx, int64_t i);           /* if NULL, integers are reported as numbers */
+    int (*string)(void* ctx, const char* s, size_t len);    /* s is not null-terminated, use len; only valid during the call */
+    int (*key)(void* ctx, const char* k, size_t klen);      /* k is not null-terminated, use klen; only valid during the call */
+    int (*start_array)(void* ctx);
+    int (*end_array)(void* ctx, size_t count);
+    int (*start_object)(void* ctx);
+    int (*end_object)(void* ctx, size_t count);
+}lept_handler;
+
+typedef struct {
+    void* (*alloc)(void* user, size_t size);
+    void* (*resize)(void* user, void* ptr, size_t old_size, size_t new_size);  /* ptr may be NULL with old_size 0 */
+    void (*dealloc)(void* user, void* ptr);
+    void* user;
+}lept_allocator;
+
+typedef struct {
+    char* stack;        /* scratch stack kept between calls */
+    size_t size;        /* capacity of the scratch stack */
+    size_t trim;        /* if nonzero, a scratch stack grown beyond trim bytes is shrunk back before the next call */
+    size_t padding;     /* readable bytes the caller guarantees after each input, see LEPT_PARSE_PADDING */
+    const lept_allocator* allocator;    /* of the scratch stack, NULL for the global allocator */
+    size_t max_depth;   /* of nested containers, 0 for LEPT_PARSE_MAX_DEPTH */
+}lept_parser;
+
+typedef struct lept_arena_block lept_arena_block;
+
+struct lept_document {
+    lept_value root;            /* parsed value, its storage lives in the arena */
+    lept_arena_block* blocks;   /* arena blocks, newest first */
+    char* top, *end;            /* free space of the newest block */
+    char* last;                 /* newest allocation, it can grow in place */
+    const lept_allocator* allocator;    /* of the arena blocks, NULL for the global allocator */
+    int error;                  /* first error met expanding lazily parsed values, LEPT_PARSE_OK if none */
+    char* map;                  /* internal: file the values borrow from, see lept_document_parse_file() */
+    size_t map_size;
+    size_t intern;              /* distinct keys shared by the members having them, 0 to copy each key */
+    struct lept_key* keys;      /* internal: those keys, kept until free, see lept_document_intern() */
+    size_t keys_count, keys_mask;
+};
+
+typedef struct {
+    lept_value v;   /* the file parsed, null on error */
+    int error;      /* LEPT_PARSE_FILE_ERROR when the file could not be read */
+    int errnum;     /* errno for LEPT_PARSE_FILE_ERROR */
+}lept_file_result;
+
+/* Push parser for input arriving in chunks, delivering SAX events to handler, or building root when handler is NULL */
+typedef struct {
+    const lept_handler* handler;
+    void* ctx;
+    lept_value root;                    /* the document once lept_stream_finish() succeeds, released by reset and free */
+    const lept_allocator* allocator;    /* of the internal buffers, NULL for the global allocator */
+    size_t max_depth;                   /* of nested containers, 0 for LEPT_PARSE_MAX_DEPTH */
+    char* stack;                        /* internal: open containers, and their values when building root */
+    size_t size, top, frame, depth;
+    char* token;                        /* internal: token split across chunks */
+    size_t token_len, token_size;
+    const char* literal;
+    int state, key, escape, error;
+}lept_stream;
+
+/* Iterates over the records of newline-delimited JSON, one per line, sharing a scratch stack and an arena */
+typedef struct {
+    lept_parser parser;     /* its settings apply to each record */
+    lept_document doc;      /* doc.root is the current record, valid until the next one */
+    int error;              /* of the current record, whose root is then null */
+    size_t line;            /* of the current record, from 1 */
+    size_t offset, length;  /* of the current record in the input */
+    const char* json;       /* internal: input */
+    const char* next, *end, *limit;
+}lept_many;
+
+/*
+ * A value as one array of 64-bit entries for reading only, each tagged in its top byte. Values are named by the index
+ * of their entry, the root being 0, and a container entry holds the index past its end, where the count is kept.
+ */
+typedef struct {
+    uint64_t* tape;                     /* entries, the root first */
+    size_t size, capacity;
+    char* strings;                      /* characters of strings and keys, each after its length and null-terminated */
+    size_t strings_size, strings_capacity;
+    const lept_allocator* allocator;    /* of the entries and strings, NULL for the global allocator */
+    size_t open;                        /* internal: innermost open container while parsing */
+}lept_tape;
+
+#define lept_init(v) do { (v)->type = LEPT_NULL; (v)->flags = 0; } while(0)
+
+#ifndef LEPT_PARSE_MAX_DEPTH
+#define LEPT_PARSE_MAX_DEPTH 1024 /* nesting of containers beyond which parsing fails with LEPT_PARSE_DEPTH_EXCEEDED */
+#endif
+
+#define LEPT_PARSE_PADDING 16 /* readable bytes lept_parse_padded() requires after the input, their content is ignored */
+
+#define LEPT_FILE_INSITU 1  /* strings are decoded into a private copy-on-write mapping of the file */
+#define LEPT_FILE_LAZY   2  /* as lept_document_parse_lazy() */
+
+/* The global allocator backs all values outside of documents and the result of lept_stringify(), change it only while none exist */
+void lept_set_allocator(const lept_allocator* allocator); /* NULL restores malloc(), realloc() and free() */
+const lept_allocator* lept_get_allocator(void);
 
 int lept_parse(lept_value* v, const char* json);
+int lept_parse_n(lept_value* v, const char* json, size_t len);
+int lept_parse_padded(lept_value* v, const char* json, size_t len);
+int lept_parse_insitu(lept_value* v, char* json, size_t len); /* strings are decoded into json, which must outlive v */
+int lept_parse_file(lept_value* v, const char* path); /* maps the file instead of reading it */
+/*
+ * Reads and parses the n files into results on up to threads threads, the calling thread among them, each parsing
+ * a file as soon as it is read. On Linux each thread submits the reads of several files at once through io_uring,
+ * unless LEPT_NO_URING is defined. Returns the number of files with an error.
+ */
+size_t lept_parse_files(const char* const* paths, size_t n, lept_file_result* results, unsigned threads);
+int lept_parse_sax(const char* json, size_t len, const lept_handler* handler, void* ctx); /* events may precede an error */
+/*
+ * Keeps only the values at the JSON Pointers in paths, and the objects and arrays leading to them. Other values are
+ * checked as by lept_parse() but not built, and skipped elements before a kept one read as null, keeping its index.
+ */
+int lept_parse_projection(lept_value* v, const char* json, size_t len, const char* const* paths, size_t n);
+/* Moves past whitespace and one value without building it, inside of which only strings and brackets are checked */
+int lept_skip_value(const char* json, size_t len, size_t* end); /* *end is the offset after the value */
 char* lept_stringify(const lept_value* v, size_t* length);
 
+void lept_parser_init(lept_parser* parser);
+void lept_parser_free(lept_parser* parser);
+int lept_parser_parse(lept_parser* parser, lept_value* v, const char* json, size_t len);
+int lept_parser_parse_insitu(lept_parser* parser, lept_value* v, char* json, size_t len);
+int lept_parser_parse_sax(lept_parser* parser, const char* json, size_t len, const lept_handler* handler, void* ctx);
+const char* lept_parser_stringify(lept_parser* parser, const lept_value* v, size_t* length); /* valid until the next call */
+
+/* Values of a document are released all at once, they must only be mutated through lept_document_*() */
+void lept_document_init(lept_document* d);
+void lept_document_reset(lept_document* d); /* releases all values but keeps memory for the next parse */
+void lept_document_free(lept_document* d);
+int lept_document_parse(lept_document* d, lept_parser* parser, const char* json, size_t len); /* parser may be NULL */
+/*
+ * Only checks that strings end and brackets match, strings and containers are parsed when first read, and their
+ * elements or members in turn. json must outlive d. A value found invalid then reads as empty and sets d->error.
+ * As first reads write to d, a lazy document must not be read from several threads at once.
+ */
+int lept_document_parse_lazy(lept_document* d, lept_parser* parser, const char* json, size_t len);
+/*
+ * Parses a root array in slices of its elements on up to threads threads, the calling thread among them, or anything
+ * else as lept_document_parse(). Invalid input is parsed again in order, giving the error lept_document_parse() gives.
+ */
+int lept_document_parse_parallel(lept_document* d, lept_parser* parser, const char* json, size_t len, unsigned threads);
+/* Maps the file, keeping it mapped until the next reset when flags, LEPT_FILE_*, make the values borrow from it */
+int lept_document_parse_file(lept_document* d, lept_parser* parser, const char* path, int flags);
+/* The copy of key members of d share, as long as d is not freed, or key itself if too many keys or too long */
+const char* lept_document_intern(lept_document* d, const char* key, size_t klen);
+void lept_document_set_string(lept_document* d, lept_value* v, const char* s, size_t len);
+void lept_document_set_array(lept_document* d, lept_value* v, size_t capacity);
+void lept_document_reserve_array(lept_document* d, lept_value* v, size_t capacity);
+lept_value* lept_document_pushback_array_element(lept_document* d, lept_value* v);
+lept_value* lept_document_insert_array_element(lept_document* d, lept_value* v, size_t index);
+void lept_document_set_object(lept_document* d, lept_value* v, size_t capacity);
+void lept_document_reserve_object(lept_document* d, lept_value* v, size_t capacity);
+lept_value* lept_document_set_object_value(lept_document* d, lept_value* v, const char* key, size_t klen);
+
+void lept_stream_init(lept_stream* s, const lept_handler* handler, void* ctx);
+void lept_stream_reset(lept_stream* s); /* starts the next document, keeping the buffers */
+void lept_stream_free(lept_stream* s);
+int lept_stream_feed(lept_stream* s, const char* buf, size_t len); /* LEPT_PARSE_OK until an error, which is kept */
+int lept_stream_finish(lept_stream* s); /* ends the input, giving the result lept_parse() gives for the whole of it */
+
+void lept_many_init(lept_many* m);
+void lept_many_free(lept_many* m);
+void lept_parse_many(lept_many* m, const char* json, size_t len); /* starts over with json, which must outlive the records */
+int lept_many_next(lept_many* m); /* moves to the next record, skipping blank lines, 0 after the last one */
+/*
+ * Parses newline-delimited JSON on up to threads workers, the calling thread among them, passing each record to
+ * record(), which returns 0 to stop with LEPT_PARSE_ABORTED. When ordered, records come in input order and one call
+ * at a time; otherwise calls come at once from the workers, records only in order within chunks of the input, and
+ * m->line may be 0. m is only valid during the call. Without threads support, records are parsed in order by the caller.
+ */
+int lept_parse_many_parallel(const char* json, size_t len, unsigned threads, int ordered, int (*record)(void* ctx, lept_many* m), void* ctx);
+
+void lept_tape_init(lept_tape* t);
+void lept_tape_free(lept_tape* t);
+int lept_tape_parse(lept_tape* t, lept_parser* parser, const char* json, size_t len); /* keeps the buffers of t, empty on error */
+lept_type lept_tape_get_type(const lept_tape* t, size_t i); /* of the value at entry i */
+int lept_tape_get_boolean(const lept_tape* t, size_t i);
+double lept_tape_get_number(const lept_tape* t, size_t i);
+int64_t lept_tape_get_int64(const lept_tape* t, size_t i);
+const char* lept_tape_get_string(const lept_tape* t, size_t i); /* or the key of the member at i */
+size_t lept_tape_get_string_length(const lept_tape* t, size_t i);
+size_t lept_tape_get_size(const lept_tape* t, size_t i); /* elements or members of the array or object at i */
+/*
+ * Elements are iterated from lept_tape_first() to lept_tape_end() with lept_tape_next(). Members are iterated the
+ * same way, by the entries of their keys, each followed by the value at the next entry.
+ */
+size_t lept_tape_first(const lept_tape* t, size_t i);
+size_t lept_tape_end(const lept_tape* t, size_t i);
+size_t lept_tape_next(const lept_tape* t, size_t i);
+size_t lept_tape_get_array_element(const lept_tape* t, size_t i, size_t index);
+size_t lept_tape_find_object_value(const lept_tape* t, size_t i, const char* key, size_t klen); /* LEPT_KEY_NOT_EXIST if none */
+
 void lept_copy(lept_value* dst, const lept_value* src);
 void lept_move(lept_value* dst, lept_value* src);
 void lept_swap(lept_value* lhs, lept_value* rhs);
@@ -64,6 +294,9 @@ void lept_set_boolean(lept_value* v, int b);
 double lept_get_number(const lept_value* v);
 void lept_set_number(lept_value* v, double n);
 
+int64_t lept_get_int64(const lept_value* v);
+void lept_set_int64(lept_value* v, int64_t i);
+
 const char* lept_get_string(const lept_value* v);
 size_t lept_get_string_length(const lept_value* v);
 void lept_set_string(lept_value* v, const char* s, size_t len);
@@ -89,6 +322,7 @@ void lept_clear_object(lept_value* v);
 const char* lept_get_object_key(const lept_value* v, size_t index);
 size_t lept_get_object_key_length(const lept_value* v, size_t index);
 lept_value* lept_get_object_value(lept_value* v, size_t index);
+/* Large objects are looked up through a hash index kept with their members, lookups do not write to v */
 size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen);
 lept_value* lept_find_object_value(lept_value* v, const char* key, size_t klen);
 lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen);
@@ -2,6 +2,8 @@
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
+#include <inttypes.h>
+#include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,6 +26,7 @@ static int test_pass = 0;
 
 #define EXPECT_EQ_INT(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%d")
 #define EXPECT_EQ_DOUBLE(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%.17g")
+#define EXPECT_EQ_INT64(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (int64_t)expect, (int64_t)actual, "%" PRId64)
 #define EXPECT_EQ_STRING(expect, actual, alength) \
     EXPECT_EQ_BASE(sizeof(expect) - 1 == alength && memcmp(expect, actual, alength + 1) == 0, expect, actual, "%s")
 #define EXPECT_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
@@ -73,11 +76,8 @@ static void test_parse_false() {
     } while(0)
 
 static void test_parse_number() {
-    TEST_NUMBER(0.0, "0");
     TEST_NUMBER(0.0, "-0");
     TEST_NUMBER(0.0, "-0.0");
-    TEST_NUMBER(1.0, "1");
-    TEST_NUMBER(-1.0, "-1");
     TEST_NUMBER(1.5, "1.5");
     TEST_NUMBER(-1.5, "-1.5");
     TEST_NUMBER(3.1416, "3.1416");
@@ -92,6 +92,9 @@ static void test_parse_number() {
     TEST_NUMBER(1.234E+10, "1.234E+10");
     TEST_NUMBER(1.234E-10, "1.234E-10");
     TEST_NUMBER(0.0, "1e-10000"); /* must underflow */
+    TEST_NUMBER(-122.41941550000001, "-122.41941550000001");
+    TEST_NUMBER(1.2345678901234567e-21, "0.0000000000000000000012345678901234567");
+    TEST_NUMBER(1.2345678901234568e+29, "123456789012345678901234567890"); /* more than 19 significant digits */
 
     TEST_NUMBER(1.0000000000000002, "1.0000000000000002"); /* the smallest number > 1 */
     TEST_NUMBER( 4.9406564584124654e-324, "4.9406564584124654e-324"); /* minimum denormal */
@@ -102,6 +105,54 @@ static void test_parse_number() {
     TEST_NUMBER(-2.2250738585072014e-308, "-2.2250738585072014e-308");
     TEST_NUMBER( 1.7976931348623157e+308, "1.7976931348623157e+308");  /* Max double */
     TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
+
+    TEST_NUMBER(9223372036854775808.0, "9223372036854775808");    /* INT64_MAX + 1 */
+    TEST_NUMBER(-9223372036854775809.0, "-9223372036854775809");  /* INT64_MIN - 1 */
+}
+
+#define TEST_INTEGER(expect, json)\
+    do {\
+        lept_value v;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(&v));\
+        EXPECT_EQ_INT64(expect, lept_get_int64(&v));\
+        EXPECT_EQ_DOUBLE((double)expect, lept_get_number(&v));\
+        lept_free(&v);\
+    } while(0)
+
+static void test_parse_integer() {
+    TEST_INTEGER(0, "0");
+    TEST_INTEGER(1, "1");
+    TEST_INTEGER(-1, "-1");
+    TEST_INTEGER(1234567890123456, "1234567890123456");
+    TEST_INTEGER(9007199254740993, "9007199254740993");   /* 2^53 + 1 is not a double */
+    TEST_INTEGER(INT64_MAX, "9223372036854775807");
+    TEST_INTEGER(INT64_MIN, "-9223372036854775808");
+}
+
+static void test_parse_number_locale() {
+    static const char* const names[] = { "", "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "fr_FR", "German", "French" };
+    lept_value v;
+    char* json;
+    size_t i, length;
+
+    /* numbers read and write a period whatever the decimal point of the locale, when one without a period exists */
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (setlocale(LC_NUMERIC, names[i]) != NULL && strcmp(localeconv()->decimal_point, ".") != 0)
+            break;
+    if (i < sizeof(names) / sizeof(names[0])) {
+        TEST_NUMBER(1.2345678901234567890e300, "1.2345678901234567890e300");
+        TEST_NUMBER(-122.41941550000001, "-122.41941550000001");
+        TEST_NUMBER(1.5, "1.5");
+        lept_init(&v);
+        lept_set_number(&v, 0.5);
+        json = lept_stringify(&v, &length);
+        EXPECT_EQ_STRING("0.5", json, length);
+        free(json);
+        lept_free(&v);
+    }
+    setlocale(LC_NUMERIC, "C");
 }
 
 #define TEST_STRING(expect, json)\
@@ -125,6 +176,10 @@ static void test_parse_string() {
     TEST_STRING("\xE2\x82\xAC", "\"\\u20AC\""); /* Euro sign U+20AC */
     TEST_STRING("\xF0\x9D\x84\x9E", "\"\\uD834\\uDD1E\"");  /* G clef sign U+1D11E */
     TEST_STRING("\xF0\x9D\x84\x9E", "\"\\ud834\\udd1e\"");  /* G clef sign U+1D11E */
+
+    /* runs longer than one scan block */
+    TEST_STRING("0123456789ABCDEF0123456789ABCDEF", "\"0123456789ABCDEF0123456789ABCDEF\"");
+    TEST_STRING("0123456789ABCDE\n0123456789ABCDEF\"", "\"0123456789ABCDE\\n0123456789ABCDEF\\\"\"");
 }
 
 static void test_parse_array() {
@@ -144,7 +199,7 @@ static void test_parse_array() {
     EXPECT_EQ_INT(LEPT_NULL,   lept_get_type(lept_get_array_element(&v, 0)));
     EXPECT_EQ_INT(LEPT_FALSE,  lept_get_type(lept_get_array_element(&v, 1)));
     EXPECT_EQ_INT(LEPT_TRUE,   lept_get_type(lept_get_array_element(&v, 2)));
-    EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(lept_get_array_element(&v, 3)));
+    EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(lept_get_array_element(&v, 3)));
     EXPECT_EQ_INT(LEPT_STRING, lept_get_type(lept_get_array_element(&v, 4)));
     EXPECT_EQ_DOUBLE(123.0, lept_get_number(lept_get_array_element(&v, 3)));
     EXPECT_EQ_STRING("abc", lept_get_string(lept_get_array_element(&v, 4)), lept_get_string_length(lept_get_array_element(&v, 4)));
@@ -160,7 +215,7 @@ static void test_parse_array() {
         EXPECT_EQ_SIZE_T(i, lept_get_array_size(a));
         for (j = 0; j < i; j++) {
             lept_value* e = lept_get_array_element(a, j);
-            EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(e));
+            EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(e));
             EXPECT_EQ_DOUBLE((double)j, lept_get_number(e));
         }
     }
@@ -198,7 +253,7 @@ static void test_parse_object() {
     EXPECT_EQ_STRING("t", lept_get_object_key(&v, 2), lept_get_object_key_length(&v, 2));
     EXPECT_EQ_INT(LEPT_TRUE,   lept_get_type(lept_get_object_value(&v, 2)));
     EXPECT_EQ_STRING("i", lept_get_object_key(&v, 3), lept_get_object_key_length(&v, 3));
-    EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(lept_get_object_value(&v, 3)));
+    EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(lept_get_object_value(&v, 3)));
     EXPECT_EQ_DOUBLE(123.0, lept_get_number(lept_get_object_value(&v, 3)));
     EXPECT_EQ_STRING("s", lept_get_object_key(&v, 4), lept_get_object_key_length(&v, 4));
     EXPECT_EQ_INT(LEPT_STRING, lept_get_type(lept_get_object_value(&v, 4)));
@@ -208,7 +263,7 @@ static void test_parse_object() {
     EXPECT_EQ_SIZE_T(3, lept_get_array_size(lept_get_object_value(&v, 5)));
     for (i = 0; i < 3; i++) {
         lept_value* e = lept_get_array_element(lept_get_object_value(&v, 5), i);
-        EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(e));
+        EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(e));
         EXPECT_EQ_DOUBLE(i + 1.0, lept_get_number(e));
     }
     EXPECT_EQ_STRING("o", lept_get_object_key(&v, 6), lept_get_object_key_length(&v, 6));
@@ -219,13 +274,15 @@ static void test_parse_object() {
             lept_value* ov = lept_get_object_value(o, i);
             EXPECT_TRUE('1' + i == lept_get_object_key(o, i)[0]);
             EXPECT_EQ_SIZE_T(1, lept_get_object_key_length(o, i));
-            EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(ov));
+            EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(ov));
             EXPECT_EQ_DOUBLE(i + 1.0, lept_get_number(ov));
         }
     }
     lept_free(&v);
 }
 
+static const lept_handler test_null_handler = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+
 #define TEST_PARSE_ERROR(error, json)\
     do {\
         lept_value v;\
@@ -234,11 +291,13 @@ static void test_parse_object() {
         EXPECT_EQ_INT(error, lept_parse(&v, json));\
         EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
         lept_free(&v);\
+        EXPECT_EQ_INT(error, lept_parse_sax(json, strlen(json), &test_null_handler, NULL));\
     } while(0)
 
 static void test_parse_expect_value() {
     TEST_PARSE_ERROR(LEPT_PARSE_EXPECT_VALUE, "");
     TEST_PARSE_ERROR(LEPT_PARSE_EXPECT_VALUE, " ");
+    TEST_PARSE_ERROR(LEPT_PARSE_EXPECT_VALUE, " \t\r\n                                 ");
 }
 
 static void test_parse_invalid_value() {
@@ -277,6 +336,7 @@ static void test_parse_number_too_big() {
 static void test_parse_miss_quotation_mark() {
     TEST_PARSE_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK, "\"");
     TEST_PARSE_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK, "\"abc");
+    TEST_PARSE_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK, "\"0123456789ABCDEF0123456789ABCDEF");
 }
 
 static void test_parse_invalid_string_escape() {
@@ -289,6 +349,7 @@ static void test_parse_invalid_string_escape() {
 static void test_parse_invalid_string_char() {
     TEST_PARSE_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"\x01\"");
     TEST_PARSE_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"\x1F\"");
+    TEST_PARSE_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"0123456789ABCDEF0123\x1F\"");
 }
 
 static void test_parse_invalid_unicode_hex() {
@@ -345,11 +406,587 @@ static void test_parse_miss_comma_or_curly_bracket() {
     TEST_PARSE_ERROR(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+/* the input is copied to an exact-size heap block so that reading past len is caught by memory checkers */
+#define TEST_PARSE_N(error, expect_type, json, len)\
+    do {\
+        lept_value v;\
+        char* buf = (char*)malloc(len);\
+        memcpy(buf, json, len);\
+        lept_init(&v);\
+        EXPECT_EQ_INT(error, lept_parse_n(&v, buf, len));\
+        EXPECT_EQ_INT(expect_type, lept_get_type(&v));\
+        lept_free(&v);\
+        free(buf);\
+    } while(0)
+
+static void test_parse_n() {
+    lept_value v;
+    char buf[4 + LEPT_PARSE_PADDING];
+
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_NULL, "null", 4);
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_INTEGER, "1234", 3);
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_NUMBER, "1.5e3", 5);
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_NUMBER, "1.00000000000000000000001", 25);
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_ARRAY, "[1,\"abc\"]xyz", 9);
+    TEST_PARSE_N(LEPT_PARSE_OK, LEPT_STRING, "\"0123456789ABCDEF0123456789\"", 28);
+    TEST_PARSE_N(LEPT_PARSE_EXPECT_VALUE, LEPT_NULL, "  null", 2);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_VALUE, LEPT_NULL, "null", 3);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_VALUE, LEPT_NULL, "1.5e3", 4);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_VALUE, LEPT_NULL, "\0", 1);
+    TEST_PARSE_N(LEPT_PARSE_ROOT_NOT_SINGULAR, LEPT_NULL, "1\0", 2);
+    TEST_PARSE_N(LEPT_PARSE_MISS_QUOTATION_MARK, LEPT_NULL, "\"abc\"", 4);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_STRING_CHAR, LEPT_NULL, "\"a\0b\"", 5);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_STRING_ESCAPE, LEPT_NULL, "\"\\n\"", 2);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_UNICODE_HEX, LEPT_NULL, "\"\\u0041\"", 6);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_UNICODE_SURROGATE, LEPT_NULL, "\"\\uD834\\uDD1E\"", 8);
+    TEST_PARSE_N(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, LEPT_NULL, "[1,2]", 4);
+    TEST_PARSE_N(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, LEPT_NULL, "{\"a\":1}", 6);
+
+    /* padding content is never interpreted */
+    memset(buf, '"', sizeof(buf));
+    memcpy(buf, "\"ab\"", 4);
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_parse_padded(&v, buf, 3));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_padded(&v, buf, 4));
+    EXPECT_EQ_STRING("ab", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+}
+
+static void test_parse_insitu() {
+    lept_value v;
+    char json[] = "{ \"a\\tb\" : [ \"\\u20AC\\uD834\\uDD1E\", \"x\" ], \"\\\"\" : \"y\\\\z\" } ";
+    char bad[] = "{ \"a\" : \"b\", \"c\" : \"\\x\" }";
+
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_insitu(&v, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&v));
+    EXPECT_EQ_SIZE_T(2, lept_get_object_size(&v));
+    EXPECT_EQ_STRING("a\tb", lept_get_object_key(&v, 0), lept_get_object_key_length(&v, 0));
+    EXPECT_EQ_STRING("\xE2\x82\xAC\xF0\x9D\x84\x9E", lept_get_string(lept_get_array_element(lept_get_object_value(&v, 0), 0)),
+        lept_get_string_length(lept_get_array_element(lept_get_object_value(&v, 0), 0)));
+    EXPECT_EQ_STRING("x", lept_get_string(lept_get_array_element(lept_get_object_value(&v, 0), 1)),
+        lept_get_string_length(lept_get_array_element(lept_get_object_value(&v, 0), 1)));
+    EXPECT_EQ_STRING("\"", lept_get_object_key(&v, 1), lept_get_object_key_length(&v, 1));
+    EXPECT_EQ_STRING("y\\z", lept_get_string(lept_get_object_value(&v, 1)), lept_get_string_length(lept_get_object_value(&v, 1)));
+    EXPECT_TRUE(lept_get_object_key(&v, 0) >= json && lept_get_object_key(&v, 0) < json + sizeof(json));
+    lept_set_string(lept_get_object_value(&v, 1), "owned", 5);
+    lept_free(&v);
+
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_STRING_ESCAPE, lept_parse_insitu(&v, bad, sizeof(bad) - 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    lept_free(&v);
+}
+
+typedef struct {
+    char trace[256];
+    size_t len;
+    int events;     /* aborts when reaching zero */
+}test_sax_context;
+
+static int test_sax_event(void* ctx, const char* s, size_t len) {
+    test_sax_context* t = (test_sax_context*)ctx;
+    if (t->len + len + 1 < sizeof(t->trace)) {
+        memcpy(t->trace + t->len, s, len);
+        t->trace[t->len += len] = ' ';
+        t->trace[++t->len] = '\0';
+    }
+    return --t->events != 0;
+}
+
+static int test_sax_null(void* ctx) { return test_sax_event(ctx, "null", 4); }
+static int test_sax_boolean(void* ctx, int b) { return b ? test_sax_event(ctx, "true", 4) : test_sax_event(ctx, "false", 5); }
+static int test_sax_start_array(void* ctx) { return test_sax_event(ctx, "[", 1); }
+static int test_sax_start_object(void* ctx) { return test_sax_event(ctx, "{", 1); }
+
+static int test_sax_number(void* ctx, double n) {
+    char buffer[32];
+    sprintf(buffer, "%g", n);
+    return test_sax_event(ctx, buffer, strlen(buffer));
+}
+
+static int test_sax_integer(void* ctx, int64_t i) {
+    char buffer[32];
+    sprintf(buffer, "i%" PRId64, i);
+    return test_sax_event(ctx, buffer, strlen(buffer));
+}
+
+static int test_sax_string(void* ctx, const char* s, size_t len) {
+    return test_sax_event(ctx, "s", 1) && test_sax_event(ctx, s, len);
+}
+
+static int test_sax_key(void* ctx, const char* k, size_t klen) {
+    return test_sax_event(ctx, "k", 1) && test_sax_event(ctx, k, klen);
+}
+
+static int test_sax_end_array(void* ctx, size_t count) {
+    char buffer[32];
+    sprintf(buffer, "]%d", (int)count);
+    return test_sax_event(ctx, buffer, strlen(buffer));
+}
+
+static int test_sax_end_object(void* ctx, size_t count) {
+    char buffer[32];
+    sprintf(buffer, "}%d", (int)count);
+    return test_sax_event(ctx, buffer, strlen(buffer));
+}
+
+#define TEST_SAX(error, expect, json, limit)\
+    do {\
+        test_sax_context t;\
+        t.len = 0;\
+        t.trace[0] = '\0';\
+        t.events = limit;\
+        EXPECT_EQ_INT(error, lept_parse_sax(json, sizeof(json) - 1, &handler, &t));\
+        EXPECT_EQ_STRING(expect, t.trace, t.len);\
+    } while(0)
+
+static void test_parse_sax() {
+    lept_handler handler = {
+        test_sax_null, test_sax_boolean, test_sax_number, test_sax_integer, test_sax_string,
+        test_sax_key, test_sax_start_array, test_sax_end_array, test_sax_start_object, test_sax_end_object
+    };
+    TEST_SAX(LEPT_PARSE_OK, "i1 ", "1", -1);
+    TEST_SAX(LEPT_PARSE_OK, "s a\nb ", "\"a\\nb\"", -1);
+    TEST_SAX(LEPT_PARSE_OK, "[ ]0 ", " [ ] ", -1);
+    TEST_SAX(LEPT_PARSE_OK, "{ k a [ null false true 1.5 s x ]5 k b { }0 }2 ",
+        "{\"a\":[null,false,true,1.5,\"x\"],\"b\":{}}", -1);
+    TEST_SAX(LEPT_PARSE_ABORTED, "{ k a [ null ", "{\"a\":[null,false,true,1.5,\"x\"],\"b\":{}}", 5);
+    TEST_SAX(LEPT_PARSE_ABORTED, "[ ]0 ", "[]", 2);
+    TEST_SAX(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[ i1 ", "[1}", -1);
+    TEST_SAX(LEPT_PARSE_ROOT_NOT_SINGULAR, "null ", "null x", -1);
+
+    handler.integer = NULL;
+    TEST_SAX(LEPT_PARSE_OK, "[ 1 2 ]2 ", "[1,2]", -1);
+}
+
+static void test_stream_split(const char* json, size_t split, size_t chunk) {
+    lept_value v;
+    lept_stream s;
+    char* expect = NULL, *actual = NULL;
+    size_t len = strlen(json), expect_len = 0, actual_len = 0, i;
+    int ret, stream_ret = LEPT_PARSE_OK;
+
+    lept_init(&v);
+    if ((ret = lept_parse_n(&v, json, len)) == LEPT_PARSE_OK)
+        expect = lept_stringify(&v, &expect_len);
+    lept_free(&v);
+
+    lept_stream_init(&s, NULL, NULL);
+    if (split > 0)
+        stream_ret = lept_stream_feed(&s, json, split);
+    for (i = split; i < len && stream_ret == LEPT_PARSE_OK; i += chunk)
+        stream_ret = lept_stream_feed(&s, json + i, len - i < chunk ? len - i : chunk);
+    if (stream_ret == LEPT_PARSE_OK)
+        stream_ret = lept_stream_finish(&s);
+    EXPECT_EQ_INT(ret, stream_ret);
+    if (stream_ret == LEPT_PARSE_OK) {
+        actual = lept_stringify(&s.root, &actual_len);
+        EXPECT_EQ_SIZE_T(expect_len, actual_len);
+        EXPECT_TRUE(memcmp(expect, actual, expect_len) == 0);
+    }
+    else
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&s.root));
+    lept_stream_free(&s);
+    free(expect);
+    free(actual);
+}
+
+static void test_parse_stream() {
+    static const char* const json[] = {
+        "null", " true ", "false", "-0.0", "123", "1.5e-3", "-9223372036854775808", "1e309",
+        "\"\"", "\"Hello\\nWorld\"", "\"\\ud834\\udd1e \\u20AC\"", "\"\\/\\\"\"",
+        "[ ]", "[ null , false , [ 1 , [ \"abc\" ] ] , { } ]",
+        " { \"n\" : null , \"a\" : [ 1, 2, 3 ] , \"o\" : { \"1\" : 1, \"2\" : \"x\" } } ",
+        "", " ", "nul", "?", "+1", "-", "1.", "1e", "0x0", "1.2.3", "[1.2.3]", "{\"a\":1-}",
+        "\"abc", "\"\\v\"", "\"\\", "\"\x01\"", "\"\\u00G0\"", "\"\\u12", "\"\\uD800\"", "\"\\uDBFF\\uE000\"",
+        "[1", "[1}", "[1 2", "[1,]", "[\"a\", nul]", "{", "{:1", "{1:1", "{\"a\"}", "{\"a\":", "{\"a\":1", "{\"a\":1]",
+        "{\"a\":[{\"b\":\"c\"}],\"d\"", "null x", "[] []", "truex"
+    };
+    size_t i, split;
+    for (i = 0; i < sizeof(json) / sizeof(json[0]); i++) {
+        for (split = 0; split <= strlen(json[i]); split++)
+            test_stream_split(json[i], split, strlen(json[i]));
+        test_stream_split(json[i], 0, 1);
+    }
+}
+
+static void test_parse_stream_sax() {
+    static const char json[] = "{\"a\":[null,false,true,1.5,\"x\"],\"b\":{}}";
+    lept_handler handler = {
+        test_sax_null, test_sax_boolean, test_sax_number, test_sax_integer, test_sax_string,
+        test_sax_key, test_sax_start_array, test_sax_end_array, test_sax_start_object, test_sax_end_object
+    };
+    test_sax_context t;
+    lept_stream s;
+    size_t i;
+
+    t.len = 0;
+    t.trace[0] = '\0';
+    t.events = -1;
+    lept_stream_init(&s, &handler, &t);
+    for (i = 0; i < sizeof(json) - 1; i++)
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_stream_feed(&s, json + i, 1));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_stream_finish(&s));
+    EXPECT_EQ_STRING("{ k a [ null false true 1.5 s x ]5 k b { }0 }2 ", t.trace, t.len);
+
+    /* the stream is reusable, and an abort is kept */
+    t.len = 0;
+    t.events = 3;
+    lept_stream_reset(&s);
+    EXPECT_EQ_INT(LEPT_PARSE_ABORTED, lept_stream_feed(&s, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_PARSE_ABORTED, lept_stream_feed(&s, "1", 1));
+    EXPECT_EQ_INT(LEPT_PARSE_ABORTED, lept_stream_finish(&s));
+    EXPECT_EQ_STRING("{ k a ", t.trace, t.len);
+    lept_stream_free(&s);
+}
+
+static void test_parse_depth() {
+    static char json[2 * 100000 + 1];
+    lept_parser parser;
+    lept_stream s;
+    lept_value v;
+    size_t i;
+
+    for (i = 0; i < LEPT_PARSE_MAX_DEPTH + 1; i++) {
+        json[i] = '[';
+        json[2 * LEPT_PARSE_MAX_DEPTH + 1 - i] = ']';
+    }
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_n(&v, json + 1, 2 * LEPT_PARSE_MAX_DEPTH));
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&v));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_parse_n(&v, json, 2 * LEPT_PARSE_MAX_DEPTH + 2));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_parse_sax(json, 2 * LEPT_PARSE_MAX_DEPTH + 2, &test_null_handler, NULL));
+    lept_stream_init(&s, NULL, NULL);
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_stream_feed(&s, json, 2 * LEPT_PARSE_MAX_DEPTH + 2));
+    lept_stream_free(&s);
+
+    /* the limit is configurable, and deep input does not exhaust the C stack */
+    for (i = 0; i < 100000; i++) {
+        json[i] = '[';
+        json[2 * 100000 - 1 - i] = ']';
+    }
+    lept_parser_init(&parser);
+    parser.max_depth = 100000;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse_sax(&parser, json, 2 * 100000, &test_null_handler, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_parser_parse(&parser, &v, json, 2 * 100000 - 1));
+    parser.max_depth = 2;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse(&parser, &v, "[{\"a\":1}]", 9));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_parser_parse(&parser, &v, "[{\"a\":[]}]", 10));
+    lept_parser_free(&parser);
+    lept_stream_init(&s, &test_null_handler, NULL);
+    s.max_depth = 100000;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_stream_feed(&s, json, 2 * 100000));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_stream_finish(&s));
+    lept_stream_free(&s);
+}
+
+#define TEST_SKIP(error, offset, json)\
+    do {\
+        size_t end = 0;\
+        EXPECT_EQ_INT(error, lept_skip_value(json, sizeof(json) - 1, &end));\
+        EXPECT_EQ_SIZE_T(offset, end);\
+    } while(0)
+
+static void test_skip_value() {
+    static char json[LEPT_PARSE_MAX_DEPTH + 1];
+    size_t end;
+
+    TEST_SKIP(LEPT_PARSE_OK, 5, " null x");
+    TEST_SKIP(LEPT_PARSE_OK, 7, " -1.5e3 ,");
+    TEST_SKIP(LEPT_PARSE_OK, 6, "\"a\\\"b\" 1");
+    TEST_SKIP(LEPT_PARSE_OK, 22, "[1, \"]\", {\"a\": [\"}\"]}] 2");
+    TEST_SKIP(LEPT_PARSE_OK, 98, "{\"key with a long name\": [[\"value \\\\ \\\" { [\", \"0123456789abcdef\"], {}], \"k\": 12345678901234567890}\n{}");
+    TEST_SKIP(LEPT_PARSE_OK, 5, "[1,,]"); /* only strings and brackets are checked within containers */
+
+    TEST_SKIP(LEPT_PARSE_EXPECT_VALUE, 0, " ");
+    TEST_SKIP(LEPT_PARSE_INVALID_VALUE, 0, "tru");
+    TEST_SKIP(LEPT_PARSE_MISS_QUOTATION_MARK, 0, "[\"abc");
+    TEST_SKIP(LEPT_PARSE_MISS_QUOTATION_MARK, 0, "\"abc\\\"");
+    TEST_SKIP(LEPT_PARSE_INVALID_STRING_CHAR, 0, "[\"a\x01\"]");
+    TEST_SKIP(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 0, "[1, [2], \"]\"");
+    TEST_SKIP(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 0, "{\"a\": [}");
+    TEST_SKIP(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, 0, "{\"a\": {\"b\": 0123456789abcdef0123456789]]]");
+
+    memset(json, '[', sizeof(json));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_skip_value(json, sizeof(json), &end));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_skip_value(NULL, 0, NULL));
+}
+
+static void test_projection(const char* expect, const char* json, const char* const* paths, size_t n) {
+    lept_value v, e;
+    lept_init(&v);
+    lept_init(&e);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projection(&v, json, strlen(json), paths, n));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&e, expect));
+    EXPECT_TRUE(lept_is_equal(&v, &e));
+    lept_free(&v);
+    lept_free(&e);
+}
+
+static void test_parse_projection() {
+    static const char json[] =
+        "{\"id\":7,\"user\":{\"name\":\"a\",\"age\":3,\"tags\":[\"x\",\"]\"]},\"items\":[{\"k\":1},{\"k\":2,\"v\":[1,2]},{\"k\":3}],"
+        "\"a/b\":1,\"m~n\":2,\"\":{\"\\u0078\":\"}\"}}";
+    static const char* const id[] = { "/id" };
+    static const char* const nested[] = { "/user/name", "/items/1/k", "/items/1/v/1" };
+    static const char* const escaped[] = { "/a~1b", "/m~0n", "//x" };
+    static const char* const whole[] = { "/user/name", "/user", "/x" };
+    static const char* const root[] = { "/id", "" };
+    static const char* const missing[] = { "/id/x", "/user/none", "/items/01", "/items/-", "/items/3" };
+    static const char* const invalid[] = {
+        "[1 2 3]", "\"\\x\"", "{\"a\":1, \"b\": [1,}", "{\"x\":[1,,2],\"id\":1}", "{\"id\":1,\"x\":[}",
+        "{\"x\":{\"a\" 1},\"id\":1}", "{\"x\":[\"\\ud800\"],\"id\":1}", "{\"x\":01,\"id\":1}", "{\"x\":[1,2],\"id\":1,}"
+    };
+    lept_value v;
+    size_t i;
+
+    test_projection("{\"id\":7}", json, id, 1);
+    test_projection("{\"user\":{\"name\":\"a\"},\"items\":[null,{\"k\":2,\"v\":[null,2]}]}", json, nested, 3);
+    test_projection("{\"a/b\":1,\"m~n\":2,\"\":{\"x\":\"}\"}}", json, escaped, 3);
+    test_projection("{\"user\":{\"name\":\"a\",\"age\":3,\"tags\":[\"x\",\"]\"]}}", json, whole, 3);
+    test_projection(json, json, root, 2);
+    test_projection("{\"user\":{},\"items\":[]}", json, missing, 5);
+    test_projection("{}", json, NULL, 0);
+    test_projection("[]", "[1]", id, 1);
+    test_projection("null", "1", id, 1);
+
+    /* skipped values are checked as by lept_parse() */
+    lept_init(&v);
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        EXPECT_EQ_INT(lept_parse(&v, invalid[i]), lept_parse_projection(&v, invalid[i], strlen(invalid[i]), id, 1));
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    }
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_parse_projection(&v, "{\"x\":1,\"id\":tru}", 16, id, 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_parse_projection(&v, "{\"x\" 1}", 7, id, 1));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse_projection(&v, "{\"id\":1} x", 10, id, 1));
+}
+
+static void test_parse_many() {
+    static const char json[] = "{\"a\":1}\n[1,\"\\n\"]\r\n\n  \ntru\n\"x\" 1\n[1,\n2]\n{\"b\":[]}";
+    lept_many m;
+
+    lept_many_init(&m);
+    lept_parse_many(&m, json, sizeof(json) - 1);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, m.error);
+    EXPECT_EQ_SIZE_T(1, m.line);
+    EXPECT_EQ_INT64(1, lept_get_int64(lept_find_object_value(&m.doc.root, "a", 1)));
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, m.error);
+    EXPECT_EQ_SIZE_T(2, lept_get_array_size(&m.doc.root));
+    EXPECT_EQ_STRING("\n", lept_get_string(lept_get_array_element(&m.doc.root, 1)), 1);
+    /* a bad record does not stop the others */
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, m.error);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&m.doc.root));
+    EXPECT_EQ_SIZE_T(5, m.line);
+    EXPECT_EQ_SIZE_T(22, m.offset);
+    EXPECT_EQ_SIZE_T(3, m.length);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, m.error);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, m.error);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, m.error);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, m.error);
+    EXPECT_EQ_SIZE_T(9, m.line);
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&m.doc.root));
+    EXPECT_FALSE(lept_many_next(&m));
+    EXPECT_FALSE(lept_many_next(&m));
+
+    /* the next batch reuses the buffers */
+    lept_parse_many(&m, "1\n\n", 3);
+    EXPECT_TRUE(lept_many_next(&m));
+    EXPECT_EQ_INT64(1, lept_get_int64(&m.doc.root));
+    EXPECT_FALSE(lept_many_next(&m));
+    EXPECT_TRUE(m.doc.blocks != NULL);
+    lept_parse_many(&m, NULL, 0);
+    EXPECT_FALSE(lept_many_next(&m));
+    lept_many_free(&m);
+    EXPECT_TRUE(m.doc.blocks == NULL && m.parser.stack == NULL);
+}
+
+#define TEST_MANY_LINES 20000
+#define TEST_MANY_WIDTH 16
+
+typedef struct {
+    char seen[TEST_MANY_LINES];
+    size_t count, stop;
+    int ordered, in_order;
+}test_many_context;
+
+/* Records of all lines have distinct slots in seen, which unordered calls may write at once */
+static int test_many_record(void* ctx, lept_many* m) {
+    test_many_context* t = (test_many_context*)ctx;
+    size_t line = m->offset / TEST_MANY_WIDTH;
+    if (line % 1000 == 999)
+        t->seen[line] = m->error == LEPT_PARSE_INVALID_VALUE && m->length == TEST_MANY_WIDTH - 1 ? 1 : 2;
+    else
+        t->seen[line] = m->error == LEPT_PARSE_OK && (size_t)lept_get_int64(lept_find_object_value(&m->doc.root, "i", 1)) == line ? 1 : 2;
+    if (t->ordered) {
+        if (m->line != line + 1 || line != t->count)
+            t->in_order = 0;
+        if (++t->count == t->stop)
+            return 0;
+    }
+    return 1;
+}
+
+static void test_parse_many_parallel() {
+    char* json = (char*)malloc(TEST_MANY_LINES * TEST_MANY_WIDTH + 1);
+    test_many_context* t = (test_many_context*)malloc(sizeof(test_many_context));
+    size_t i, seen;
+    int ordered;
+    unsigned threads;
+
+    for (i = 0; i < TEST_MANY_LINES; i++)
+        if (i % 1000 == 999)
+            sprintf(json + i * TEST_MANY_WIDTH, "%-15s\n", "x");
+        else
+            sprintf(json + i * TEST_MANY_WIDTH, "{\"i\":%9u}\n", (unsigned)i);
+    for (threads = 1; threads <= 4; threads += 3)
+        for (ordered = 0; ordered <= 1; ordered++) {
+            memset(t, 0, sizeof(test_many_context));
+            t->ordered = ordered;
+            t->in_order = 1;
+            EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_many_parallel(json, TEST_MANY_LINES * TEST_MANY_WIDTH, threads, ordered, test_many_record, t));
+            for (i = seen = 0; i < TEST_MANY_LINES; i++)
+                seen += t->seen[i] == 1;
+            EXPECT_EQ_SIZE_T(TEST_MANY_LINES, seen);
+            EXPECT_TRUE(t->in_order);
+        }
+
+    /* no record follows the one stopping the parse */
+    memset(t, 0, sizeof(test_many_context));
+    t->ordered = t->in_order = 1;
+    t->stop = 5000;
+    EXPECT_EQ_INT(LEPT_PARSE_ABORTED, lept_parse_many_parallel(json, TEST_MANY_LINES * TEST_MANY_WIDTH, 4, 1, test_many_record, t));
+    EXPECT_EQ_SIZE_T(5000, t->count);
+    EXPECT_TRUE(t->in_order);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_many_parallel(NULL, 0, 4, 1, test_many_record, t));
+
+    /* chunks holding only blank lines */
+    memset(json + 5000 * TEST_MANY_WIDTH, '\n', (TEST_MANY_LINES - 5000) * TEST_MANY_WIDTH);
+    for (threads = 2; threads <= 4; threads += 2)
+        for (ordered = 0; ordered <= 1; ordered++) {
+            memset(t, 0, sizeof(test_many_context));
+            t->ordered = ordered;
+            t->in_order = 1;
+            EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_many_parallel(json, TEST_MANY_LINES * TEST_MANY_WIDTH, threads, ordered, test_many_record, t));
+            for (i = seen = 0; i < TEST_MANY_LINES; i++)
+                seen += t->seen[i] == 1;
+            EXPECT_EQ_SIZE_T(5000, seen);
+            EXPECT_TRUE(t->in_order);
+        }
+    free(t);
+    free(json);
+}
+
+#define TEST_FILE "leptjson_test.json"
+
+static void test_write_file(const char* json, size_t len) {
+    FILE* fp = fopen(TEST_FILE, "wb");
+    EXPECT_TRUE(fp != NULL && fwrite(json, 1, len, fp) == len);
+    fclose(fp);
+}
+
+static void test_parse_file() {
+    char json[4096];
+    size_t i;
+    lept_value v;
+
+    test_write_file("{\"a\":[1,\"\\u00e9\"]}", 18);
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, TEST_FILE));
+    EXPECT_EQ_STRING("\xC3\xA9", lept_get_string(lept_get_array_element(lept_find_object_value(&v, "a", 1), 1)), 2);
+    lept_free(&v);
+
+    /* a file filling its last page has no padding */
+    json[0] = '[';
+    for (i = 1; i < sizeof(json) - 1; i++)
+        json[i] = i % 2 ? '1' : ',';
+    json[sizeof(json) - 1] = '"';
+    test_write_file(json, sizeof(json));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_parse_file(&v, TEST_FILE));
+    json[sizeof(json) - 2] = ' ';
+    json[sizeof(json) - 1] = ']';
+    test_write_file(json, sizeof(json));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, TEST_FILE));
+    EXPECT_EQ_SIZE_T(sizeof(json) / 2 - 1, lept_get_array_size(&v));
+    lept_free(&v);
+
+    test_write_file("", 0);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_parse_file(&v, TEST_FILE));
+    remove(TEST_FILE);
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_parse_file(&v, TEST_FILE));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+static void test_parse_files() {
+    static const char* paths[] = { "leptjson_test0.json", "leptjson_test1.json", "leptjson_missing.json", "leptjson_test2.json" };
+    static char names[100][32];
+    static const char* many[100];
+    static lept_file_result manyresults[100];
+    lept_file_result results[4];
+    unsigned threads;
+    FILE* fp;
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+        if (i != 2 && (fp = fopen(paths[i], "wb")) != NULL) {
+            fputs(i == 0 ? "[1,2,3]" : i == 1 ? " \"abc\" " : "{\"a\":", fp);
+            fclose(fp);
+        }
+    for (threads = 1; threads <= 8; threads *= 8) {
+        EXPECT_EQ_SIZE_T(2, lept_parse_files(paths, 4, results, threads));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, results[0].error);
+        EXPECT_EQ_SIZE_T(3, lept_get_array_size(&results[0].v));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, results[1].error);
+        EXPECT_EQ_STRING("abc", lept_get_string(&results[1].v), lept_get_string_length(&results[1].v));
+        EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, results[2].error);
+        EXPECT_TRUE(results[2].errnum != 0);
+        EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, results[3].error);
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&results[3].v));
+        for (i = 0; i < 4; i++)
+            lept_free(&results[i].v);
+    }
+    EXPECT_EQ_SIZE_T(0, lept_parse_files(NULL, 0, NULL, 4));
+    for (i = 0; i < 4; i++)
+        remove(paths[i]);
+
+    /* more files than are read at once */
+    for (i = 0; i < 100; i++) {
+        sprintf(names[i], "leptjson_test%d.json", (int)i);
+        many[i] = names[i];
+        if ((fp = fopen(many[i], "wb")) != NULL) {
+            fprintf(fp, "[%d]", (int)i);
+            fclose(fp);
+        }
+    }
+    for (threads = 1; threads <= 3; threads += 2) {
+        EXPECT_EQ_SIZE_T(0, lept_parse_files(many, 100, manyresults, threads));
+        for (i = 0; i < 100; i++) {
+            EXPECT_EQ_INT64((int64_t)i, lept_get_int64(lept_get_array_element(&manyresults[i].v, 0)));
+            lept_free(&manyresults[i].v);
+        }
+    }
+    for (i = 0; i < 100; i++)
+        remove(many[i]);
+}
+
 static void test_parse() {
     test_parse_null();
     test_parse_true();
     test_parse_false();
     test_parse_number();
+    test_parse_integer();
+    test_parse_number_locale();
     test_parse_string();
     test_parse_array();
     test_parse_object();
@@ -367,6 +1004,18 @@ static void test_parse() {
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_parse_n();
+    test_parse_insitu();
+    test_parse_sax();
+    test_parse_stream();
+    test_parse_stream_sax();
+    test_parse_depth();
+    test_skip_value();
+    test_parse_projection();
+    test_parse_many();
+    test_parse_many_parallel();
+    test_parse_file();
+    test_parse_files();
 }
 
 #define TEST_ROUNDTRIP(json)\
@@ -403,6 +1052,12 @@ static void test_stringify_number() {
     TEST_ROUNDTRIP("-2.2250738585072014e-308");
     TEST_ROUNDTRIP("1.7976931348623157e+308");  /* Max double */
     TEST_ROUNDTRIP("-1.7976931348623157e+308");
+
+    TEST_ROUNDTRIP("10");
+    TEST_ROUNDTRIP("-99");
+    TEST_ROUNDTRIP("1234567890123456789");
+    TEST_ROUNDTRIP("9223372036854775807");
+    TEST_ROUNDTRIP("-9223372036854775808");
 }
 
 static void test_stringify_string() {
@@ -411,6 +1066,7 @@ static void test_stringify_string() {
     TEST_ROUNDTRIP("\"Hello\\nWorld\"");
     TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
+    TEST_ROUNDTRIP("\"0123456789ABCDEF0123456789ABCDE\\t0123456789ABCDEF\\u001F\"");
 }
 
 static void test_stringify_array() {
@@ -453,6 +1109,9 @@ static void test_equal() {
     TEST_EQUAL("null", "0", 0);
     TEST_EQUAL("123", "123", 1);
     TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("123", "123.0", 1);
+    TEST_EQUAL("1e2", "100", 1);
+    TEST_EQUAL("9223372036854775807", "9223372036854775807.0", 0);
     TEST_EQUAL("\"abc\"", "\"abc\"", 1);
     TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
     TEST_EQUAL("[]", "[]", 1);
@@ -468,6 +1127,10 @@ static void test_equal() {
     TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":3}", 0);
     TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":2,\"c\":3}", 0);
     TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":{}}}}", 1);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":1,\"a\":2}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":0,\"a\":2}", "{\"b\":0,\"a\":1,\"a\":2}", 1);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":2,\"a\":1}", 0);
+    TEST_EQUAL("{\"a\":1,\"a\":1}", "{\"a\":1,\"b\":1}", 0);
     TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":[]}}}", 0);
 }
 
@@ -482,6 +1145,63 @@ static void test_copy() {
     lept_free(&v2);
 }
 
+static void test_copy_deep() {
+    static char json[6 * 100000 + 1];
+    lept_parser parser;
+    lept_value v1, v2, *e;
+    char* insitu, *stringified;
+    size_t i, n = 0, length;
+
+    /* {"a":[{"a":[...]}]} nested 100000 levels deep */
+    for (i = 0; i < 100000 / 2; i++) {
+        memcpy(json + n, "{\"a\":[", 6);
+        n += 6;
+    }
+    json[n++] = '1';
+    for (i = 0; i < 100000 / 2; i++) {
+        memcpy(json + n, "]}", 2);
+        n += 2;
+    }
+    lept_parser_init(&parser);
+    parser.max_depth = 100000;
+    lept_init(&v1);
+    lept_init(&v2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse(&parser, &v1, json, n));
+    lept_copy(&v2, &v1);
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+    stringified = lept_stringify(&v2, &length);
+    EXPECT_EQ_SIZE_T(n, length);
+    EXPECT_TRUE(memcmp(json, stringified, n) == 0);
+    free(stringified);
+    for (e = &v2; lept_get_type(e) != LEPT_INTEGER; )
+        e = lept_get_type(e) == LEPT_OBJECT ? lept_get_object_value(e, 0) : lept_get_array_element(e, 0);
+    lept_set_int64(e, 2);
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_free(&v2);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v2));
+
+    /* a copy owns what the original borrows */
+    insitu = (char*)malloc(n);
+    memcpy(insitu, json, n);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse_insitu(&parser, &v2, insitu, n));
+    lept_copy(&v1, &v2);
+    lept_free(&v2);
+    free(insitu);
+    EXPECT_EQ_STRING("a", lept_get_object_key(&v1, 0), lept_get_object_key_length(&v1, 0));
+    lept_free(&v1);
+    lept_parser_free(&parser);
+
+    /* elements of a parsed array of scalars can still be given storage */
+    lept_parse(&v1, "[1,2.5,true,null]");
+    lept_copy(&v2, &v1);
+    lept_set_string(lept_get_array_element(&v1, 0), "abc", 3);
+    lept_set_array(lept_pushback_array_element(&v2), 1);
+    lept_set_string(lept_pushback_array_element(lept_get_array_element(&v2, 4)), "abc", 3);
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_free(&v1);
+    lept_free(&v2);
+}
+
 static void test_move() {
     lept_value v1, v2, v3;
     lept_init(&v1);
@@ -510,6 +1230,435 @@ static void test_swap() {
     lept_free(&v2);
 }
 
+static void test_parser() {
+    static const char json[] = "[\"0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF\",{\"a\":1.5}]";
+    lept_parser parser;
+    lept_value v;
+    const char* json2;
+    size_t size, length;
+    int i;
+
+    lept_parser_init(&parser);
+    lept_init(&v);
+    for (i = 0; i < 3; i++) {
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse(&parser, &v, json, sizeof(json) - 1));
+        EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&v));
+        EXPECT_TRUE(parser.stack != NULL);
+        json2 = lept_parser_stringify(&parser, &v, &length);
+        EXPECT_EQ_STRING(json, json2, length);
+        if (i == 0)
+            size = parser.size;
+        EXPECT_EQ_SIZE_T(size, parser.size);   /* stack is reused, not regrown */
+        lept_free(&v);
+    }
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_parser_parse(&parser, &v, json, sizeof(json) - 2));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+
+    parser.trim = 16;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parser_parse(&parser, &v, "true", 4));
+    EXPECT_TRUE(parser.size <= 16);
+    lept_free(&v);
+    lept_parser_free(&parser);
+    EXPECT_TRUE(parser.stack == NULL);
+}
+
+static void test_document() {
+    static const char json[] = "{\"a\":[1,\"abc\",{\"b\":null}],\"c\":\"\\u20AC\"}";
+    lept_document d;
+    lept_value* a, *e;
+    char key[8];
+    size_t i;
+
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&d.root));
+    EXPECT_EQ_SIZE_T(2, lept_get_object_size(&d.root));
+    a = lept_find_object_value(&d.root, "a", 1);
+    EXPECT_TRUE(a != NULL && lept_get_type(a) == LEPT_ARRAY);
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(a));
+    EXPECT_EQ_STRING("abc", lept_get_string(lept_get_array_element(a, 1)), lept_get_string_length(lept_get_array_element(a, 1)));
+    EXPECT_EQ_STRING("\xE2\x82\xAC", lept_get_string(lept_find_object_value(&d.root, "c", 1)), 3);
+
+    /* grow across several arena blocks */
+    for (i = 0; i < 1000; i++)
+        lept_set_int64(lept_document_pushback_array_element(&d, a), (int64_t)i);
+    EXPECT_EQ_SIZE_T(1003, lept_get_array_size(a));
+    EXPECT_EQ_INT64(999, lept_get_int64(lept_get_array_element(a, 1002)));
+    lept_document_set_string(&d, lept_document_insert_array_element(&d, a, 0), "x", 1);
+    EXPECT_EQ_STRING("x", lept_get_string(lept_get_array_element(a, 0)), 1);
+    EXPECT_EQ_INT64(0, lept_get_int64(lept_get_array_element(a, 4)));
+    lept_popback_array_element(a);
+    EXPECT_EQ_SIZE_T(1003, lept_get_array_size(a));
+
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "k%d", (int)i);
+        lept_set_boolean(lept_document_set_object_value(&d, &d.root, key, strlen(key)), 1);
+    }
+    EXPECT_EQ_SIZE_T(102, lept_get_object_size(&d.root));
+    EXPECT_EQ_INT(LEPT_TRUE, lept_get_type(lept_find_object_value(&d.root, "k99", 3)));
+    lept_document_set_array(&d, e = lept_document_set_object_value(&d, &d.root, "e", 1), 0);
+    lept_document_set_object(&d, lept_document_pushback_array_element(&d, e), 0);
+    EXPECT_EQ_SIZE_T(1, lept_get_array_size(e));
+
+    /* reset keeps the memory for the next document */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, sizeof(json) - 1));
+    EXPECT_EQ_SIZE_T(2, lept_get_object_size(&d.root));
+    EXPECT_TRUE(d.blocks != NULL);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_document_parse(&d, NULL, json, sizeof(json) - 2));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&d.root));
+    lept_document_free(&d);
+    EXPECT_TRUE(d.blocks == NULL);
+}
+
+static void test_document_intern() {
+    static const char json[] = "[{\"id\":1,\"name\":\"a\"},{\"name\":\"b\",\"id\":2},{\"0123456789012345678901234567890123456789012345678901234567890123456789\":3}]";
+    lept_document d;
+    lept_value* a, *b;
+    const char* id;
+    char key[8];
+    size_t i;
+
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, sizeof(json) - 1));
+    a = lept_get_array_element(&d.root, 0);
+    b = lept_get_array_element(&d.root, 1);
+    EXPECT_TRUE(lept_get_object_key(a, 0) == lept_get_object_key(b, 1));
+    EXPECT_TRUE(lept_get_object_key(a, 1) == lept_get_object_key(b, 0));
+    id = lept_document_intern(&d, "id", 2);
+    EXPECT_TRUE(id == lept_get_object_key(a, 0));
+    EXPECT_EQ_SIZE_T(1, lept_find_object_index(b, id, 2));
+    EXPECT_TRUE(lept_document_set_object_value(&d, lept_get_array_element(&d.root, 2), "id", 2) != NULL);
+    EXPECT_TRUE(lept_get_object_key(lept_get_array_element(&d.root, 2), 1) == id);
+
+    /* interned keys outlive reset, long keys are only copied */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, sizeof(json) - 1));
+    EXPECT_TRUE(lept_get_object_key(lept_get_array_element(&d.root, 1), 1) == id);
+    EXPECT_EQ_SIZE_T(2, d.keys_count);
+    a = lept_get_array_element(&d.root, 2);
+    EXPECT_EQ_SIZE_T(0, lept_find_object_index(a, lept_document_intern(&d, lept_get_object_key(a, 0), 70), 70));
+    EXPECT_EQ_SIZE_T(2, d.keys_count);
+
+    /* beyond d.intern keys, they are copied as they come */
+    d.intern = 4;
+    for (i = 0; i < 10; i++) {
+        sprintf(key, "k%d", (int)i);
+        EXPECT_TRUE((lept_document_intern(&d, key, 2) == key) == (i >= 2));
+    }
+    EXPECT_EQ_SIZE_T(4, d.keys_count);
+    EXPECT_TRUE(lept_document_intern(&d, "k1", 2) != key);
+    lept_document_free(&d);
+    EXPECT_EQ_SIZE_T(4, d.intern);
+
+    d.intern = 0;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, sizeof(json) - 1));
+    EXPECT_TRUE(lept_get_object_key(lept_get_array_element(&d.root, 0), 0) != lept_get_object_key(lept_get_array_element(&d.root, 1), 1));
+    EXPECT_TRUE(d.keys == NULL);
+    lept_document_free(&d);
+}
+
+static void test_document_parallel_json(const char* json, size_t len, int error) {
+    lept_document d, e;
+    unsigned threads;
+    lept_document_init(&d);
+    lept_document_init(&e);
+    EXPECT_EQ_INT(error, lept_document_parse(&e, NULL, json, len));
+    for (threads = 1; threads <= 16; threads *= 4) {
+        EXPECT_EQ_INT(error, lept_document_parse_parallel(&d, NULL, json, len, threads));
+        EXPECT_TRUE(lept_is_equal(&d.root, &e.root));
+    }
+    lept_document_free(&d);
+    lept_document_free(&e);
+}
+
+static void test_document_parallel() {
+    static const char* elements[] = {
+        "{\"a\":[1,\"],[\"],\"b\":{\"c\":\"\\\\\"}}", "\"\\\",\\\\\"", "[[],{},\"\\\\\\\\\"]", "12345", "true", "\"x\""
+    };
+    size_t cap = 1 << 20, len = 0, n, i;
+    char* json = (char*)malloc(cap);
+    lept_document d;
+
+    json[len++] = '[';
+    for (i = 0; len < cap - 64; i++) {
+        n = strlen(elements[i % 6]);
+        memcpy(json + len, elements[i % 6], n);
+        len += n;
+        json[len++] = ',';
+        if (i % 7 == 0)
+            json[len++] = '\n';
+    }
+    json[len - 1] = ']';
+    test_document_parallel_json(json, len, LEPT_PARSE_OK);
+
+    /* scalars only */
+    len |= 1;
+    for (i = 1; i < len - 1; i++)
+        json[i] = i % 2 ? '1' : ',';
+    json[len - 1] = ']';
+    test_document_parallel_json(json, len, LEPT_PARSE_OK);
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_parallel(&d, NULL, json, len, 4));
+    EXPECT_EQ_SIZE_T(len / 2, lept_get_array_size(&d.root));
+    lept_document_free(&d);
+
+    /* one string across all chunks */
+    json[1] = '"';
+    json[len - 2] = '"';
+    for (i = 2; i < len - 2; i++)
+        json[i] = i % 3 == 2 || i - i % 3 + 1 >= len - 2 ? ',' : '\\';
+    test_document_parallel_json(json, len, LEPT_PARSE_OK);
+    json[len - 2] = ',';
+    test_document_parallel_json(json, len, LEPT_PARSE_MISS_QUOTATION_MARK);
+    json[len - 2] = '"';
+    for (i = 2; i < len - 2; i++)
+        json[i] = i % 3 ? ',' : '[';
+    test_document_parallel_json(json, len, LEPT_PARSE_OK);
+
+    /* errors come from parsing in order */
+    json[len / 2] = '"';
+    test_document_parallel_json(json, len, LEPT_PARSE_INVALID_VALUE);
+    for (i = 1; i < len - 1; i++)
+        json[i] = i % 2 ? '1' : ',';
+    n = len / 3 * 2 | 1;
+    json[n] = '"';
+    test_document_parallel_json(json, len, LEPT_PARSE_MISS_QUOTATION_MARK);
+    json[n] = ',';
+    test_document_parallel_json(json, len, LEPT_PARSE_INVALID_VALUE);
+    json[n] = '1';
+    json[n + 1] = ']';
+    test_document_parallel_json(json, len, LEPT_PARSE_ROOT_NOT_SINGULAR);
+    json[n + 1] = ',';
+    json[0] = '{';
+    test_document_parallel_json(json, len, LEPT_PARSE_MISS_KEY);
+    free(json);
+}
+
+static void test_document_file() {
+    static const char json[] = "[\"a\\tb\",{\"k\":\"v\"}]";
+    char back[sizeof(json)];
+    const char* s;
+    lept_document d;
+    FILE* fp;
+
+    test_write_file(json, sizeof(json) - 1);
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_file(&d, NULL, TEST_FILE, 0));
+    EXPECT_TRUE(d.map == NULL);
+    EXPECT_EQ_STRING("a\tb", lept_get_string(lept_get_array_element(&d.root, 0)), 3);
+
+    /* strings are decoded into the mapping, not into the file */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_file(&d, NULL, TEST_FILE, LEPT_FILE_INSITU));
+    s = lept_get_string(lept_get_array_element(&d.root, 0));
+    EXPECT_EQ_STRING("a\tb", s, 3);
+    EXPECT_TRUE(s >= d.map && s < d.map + d.map_size);
+    EXPECT_EQ_STRING("v", lept_get_string(lept_find_object_value(lept_get_array_element(&d.root, 1), "k", 1)), 1);
+    fp = fopen(TEST_FILE, "rb");
+    EXPECT_TRUE(fp != NULL && fread(back, 1, sizeof(back), fp) == sizeof(json) - 1);
+    fclose(fp);
+    back[sizeof(json) - 1] = '\0';
+    EXPECT_EQ_STRING(json, back, sizeof(json) - 1);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_file(&d, NULL, TEST_FILE, LEPT_FILE_LAZY));
+    EXPECT_EQ_SIZE_T(2, lept_get_array_size(&d.root));
+    EXPECT_EQ_STRING("a\tb", lept_get_string(lept_get_array_element(&d.root, 0)), 3);
+    lept_document_reset(&d);
+    EXPECT_TRUE(d.map == NULL);
+
+    test_write_file("[1,", 3);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_document_parse_file(&d, NULL, TEST_FILE, LEPT_FILE_INSITU));
+    EXPECT_TRUE(d.map == NULL);
+    remove(TEST_FILE);
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_document_parse_file(&d, NULL, TEST_FILE, 0));
+    lept_document_free(&d);
+}
+
+static void test_document_lazy() {
+    static const char json[] = " {\"a\" : [1, \"x\\ny\", {\"b\": [true]}], \"c\": \"\\u20AC\", \"d\": [tru], \"e\": \"\\q\"} ";
+    static const char valid[] = "{\"a\" : [1, \"x\\ny\", {\"b\": [true]}], \"c\": \"\\u20AC\"}";
+    lept_document d;
+    lept_value v, *a, *e;
+    char* str;
+    size_t len;
+
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&d.root));
+#ifndef LEPT_COMPACT
+    EXPECT_TRUE(d.blocks == NULL); /* compact values keep the text of lazy ones in the arena */
+#endif
+    a = lept_find_object_value(&d.root, "a", 1);
+    EXPECT_TRUE(a != NULL && lept_get_type(a) == LEPT_ARRAY);
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(a));
+    EXPECT_EQ_INT64(1, lept_get_int64(lept_get_array_element(a, 0)));
+    EXPECT_EQ_STRING("x\ny", lept_get_string(lept_get_array_element(a, 1)), lept_get_string_length(lept_get_array_element(a, 1)));
+    e = lept_find_object_value(lept_get_array_element(a, 2), "b", 1);
+    EXPECT_TRUE(e != NULL && lept_get_boolean(lept_get_array_element(e, 0)));
+    EXPECT_EQ_STRING("\xE2\x82\xAC", lept_get_string(lept_find_object_value(&d.root, "c", 1)), 3);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, d.error);
+
+    /* invalid values are only found when read */
+    EXPECT_EQ_SIZE_T(0, lept_get_array_size(lept_find_object_value(&d.root, "d", 1)));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, d.error);
+    EXPECT_EQ_SIZE_T(0, lept_get_string_length(lept_find_object_value(&d.root, "e", 1)));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, d.error);
+
+    /* values are expanded as they are compared, copied or stringified */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, valid, sizeof(valid) - 1));
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, valid));
+    EXPECT_TRUE(lept_is_equal(&d.root, &v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, valid, sizeof(valid) - 1));
+    lept_copy(&v, &d.root);
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(lept_find_object_value(&v, "a", 1)));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, valid, sizeof(valid) - 1));
+    str = lept_stringify(&d.root, &len);
+    EXPECT_EQ_STRING("{\"a\":[1,\"x\\ny\",{\"b\":[true]}],\"c\":\"\xE2\x82\xAC\"}", str, len);
+    free(str);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, d.error);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, "\"a\"", 3));
+    EXPECT_EQ_STRING("a", lept_get_string(&d.root), lept_get_string_length(&d.root));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse_lazy(&d, NULL, "-1.5", 4));
+    EXPECT_EQ_DOUBLE(-1.5, lept_get_number(&d.root));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_document_parse_lazy(&d, NULL, "[\"a]", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_document_parse_lazy(&d, NULL, "[\"a\\\"]", 6));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_STRING_CHAR, lept_document_parse_lazy(&d, NULL, "[\"\x01\"]", 5));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_document_parse_lazy(&d, NULL, "[{}}", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_document_parse_lazy(&d, NULL, "{\"a\":]", 6));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_document_parse_lazy(&d, NULL, "[] x", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_document_parse_lazy(&d, NULL, " ", 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&d.root));
+    lept_document_free(&d);
+}
+
+static void test_tape() {
+    static const char json[] = " {\"a\" : [1, -2.5, \"x\\u0000y\", [], {}], \"b\": {\"c\": [true, false, null]}, \"\": \"\"} ";
+    lept_tape t;
+    lept_parser parser;
+    size_t a, b, e, i, n;
+
+    lept_tape_init(&t);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_tape_parse(&t, NULL, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_tape_get_type(&t, 0));
+    EXPECT_EQ_SIZE_T(3, lept_tape_get_size(&t, 0));
+    EXPECT_EQ_SIZE_T(t.size - 1, lept_tape_end(&t, 0));
+    EXPECT_EQ_SIZE_T(t.size, lept_tape_next(&t, 0));
+
+    a = lept_tape_find_object_value(&t, 0, "a", 1);
+    EXPECT_TRUE(a != LEPT_KEY_NOT_EXIST && lept_tape_get_type(&t, a) == LEPT_ARRAY);
+    EXPECT_EQ_SIZE_T(5, lept_tape_get_size(&t, a));
+    EXPECT_EQ_INT64(1, lept_tape_get_int64(&t, lept_tape_get_array_element(&t, a, 0)));
+    EXPECT_EQ_DOUBLE(1.0, lept_tape_get_number(&t, lept_tape_get_array_element(&t, a, 0)));
+    EXPECT_EQ_DOUBLE(-2.5, lept_tape_get_number(&t, lept_tape_get_array_element(&t, a, 1)));
+    e = lept_tape_get_array_element(&t, a, 2);
+    EXPECT_EQ_STRING("x\0y", lept_tape_get_string(&t, e), lept_tape_get_string_length(&t, e));
+    EXPECT_EQ_SIZE_T(0, lept_tape_get_size(&t, lept_tape_get_array_element(&t, a, 3)));
+    e = lept_tape_get_array_element(&t, a, 4);
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_tape_get_type(&t, e));
+    EXPECT_EQ_SIZE_T(lept_tape_first(&t, e), lept_tape_end(&t, e));
+    EXPECT_EQ_SIZE_T(lept_tape_end(&t, a), lept_tape_next(&t, e));
+
+    b = lept_tape_find_object_value(&t, lept_tape_find_object_value(&t, 0, "b", 1), "c", 1);
+    for (e = lept_tape_first(&t, b), n = 0; e != lept_tape_end(&t, b); e = lept_tape_next(&t, e), n++)
+        EXPECT_EQ_INT(n == 0 ? LEPT_TRUE : n == 1 ? LEPT_FALSE : LEPT_NULL, lept_tape_get_type(&t, e));
+    EXPECT_EQ_SIZE_T(3, n);
+    EXPECT_TRUE(lept_tape_get_boolean(&t, lept_tape_first(&t, b)));
+
+    for (i = lept_tape_first(&t, 0), n = 0; i != lept_tape_end(&t, 0); i = lept_tape_next(&t, i), n++)
+        EXPECT_EQ_SIZE_T((size_t)(n == 2 ? 0 : 1), lept_tape_get_string_length(&t, i));
+    EXPECT_EQ_SIZE_T(3, n);
+    EXPECT_EQ_SIZE_T(0, lept_tape_get_string_length(&t, lept_tape_find_object_value(&t, 0, "", 0)));
+    EXPECT_TRUE(lept_tape_find_object_value(&t, 0, "c", 1) == LEPT_KEY_NOT_EXIST);
+
+    lept_parser_init(&parser);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_tape_parse(&t, &parser, "\"abc\"", 5));
+    EXPECT_EQ_SIZE_T(1, t.size);
+    EXPECT_EQ_STRING("abc", lept_tape_get_string(&t, 0), lept_tape_get_string_length(&t, 0));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_tape_parse(&t, &parser, "[1,{\"a\":2}}", 11));
+    EXPECT_EQ_SIZE_T(0, t.size);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_tape_parse(&t, &parser, "[[[]],0]", 8));
+    EXPECT_EQ_SIZE_T(2, lept_tape_get_size(&t, 0));
+    EXPECT_EQ_SIZE_T(1, lept_tape_get_size(&t, lept_tape_first(&t, 0)));
+    EXPECT_EQ_INT64(0, lept_tape_get_int64(&t, lept_tape_get_array_element(&t, 0, 1)));
+    lept_parser_free(&parser);
+    lept_tape_free(&t);
+}
+
+typedef struct {
+    int allocs, live;
+}test_alloc_stats;
+
+static void* test_alloc(void* user, size_t size) {
+    test_alloc_stats* stats = (test_alloc_stats*)user;
+    stats->allocs++;
+    stats->live++;
+    return malloc(size);
+}
+
+static void* test_resize(void* user, void* ptr, size_t old_size, size_t new_size) {
+    test_alloc_stats* stats = (test_alloc_stats*)user;
+    EXPECT_TRUE(ptr != NULL || old_size == 0);
+    stats->allocs++;
+    if (ptr == NULL)
+        stats->live++;
+    return realloc(ptr, new_size);
+}
+
+static void test_dealloc(void* user, void* ptr) {
+    test_alloc_stats* stats = (test_alloc_stats*)user;
+    if (ptr != NULL)
+        stats->live--;
+    free(ptr);
+}
+
+static void test_allocator() {
+    static const char json[] = "{\"a\":[1,\"abc\",{\"b\":null}],\"c\":\"\\u20AC\"}";
+    test_alloc_stats global = { 0, 0 }, scratch = { 0, 0 }, arena = { 0, 0 };
+    lept_allocator global_allocator = { test_alloc, test_resize, test_dealloc, NULL };
+    lept_allocator scratch_allocator = { test_alloc, test_resize, test_dealloc, NULL };
+    lept_allocator arena_allocator = { test_alloc, test_resize, test_dealloc, NULL };
+    lept_parser parser;
+    lept_document d;
+    lept_value v;
+    char* json2;
+    size_t length;
+
+    global_allocator.user = &global;
+    scratch_allocator.user = &scratch;
+    arena_allocator.user = &arena;
+    lept_set_allocator(&global_allocator);
+    EXPECT_TRUE(lept_get_allocator() == &global_allocator);
+
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    json2 = lept_stringify(&v, &length);
+    EXPECT_EQ_STRING("{\"a\":[1,\"abc\",{\"b\":null}],\"c\":\"\xE2\x82\xAC\"}", json2, length);
+    EXPECT_TRUE(global.allocs > 0);
+    test_dealloc(&global, json2);
+    lept_free(&v);
+    EXPECT_EQ_INT(0, global.live);
+
+    /* the parser's scratch stack and the document's arena use their own allocators */
+    global.allocs = 0;
+    lept_parser_init(&parser);
+    parser.allocator = &scratch_allocator;
+    lept_document_init(&d);
+    d.allocator = &arena_allocator;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, &parser, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(0, global.allocs);
+    EXPECT_TRUE(scratch.allocs > 0);
+    EXPECT_TRUE(arena.allocs > 0);
+    lept_document_free(&d);
+    lept_parser_free(&parser);
+    EXPECT_TRUE(parser.allocator == &scratch_allocator);
+    EXPECT_EQ_INT(0, scratch.live);
+    EXPECT_EQ_INT(0, arena.live);
+
+    lept_set_allocator(NULL);
+    EXPECT_TRUE(lept_get_allocator() != &global_allocator);
+}
+
 static void test_access_null() {
     lept_value v;
     lept_init(&v);
@@ -539,6 +1688,16 @@ static void test_access_number() {
     lept_free(&v);
 }
 
+static void test_access_int64() {
+    lept_value v;
+    lept_init(&v);
+    lept_set_string(&v, "a", 1);
+    lept_set_int64(&v, INT64_MIN);
+    EXPECT_EQ_INT(LEPT_INTEGER, lept_get_type(&v));
+    EXPECT_EQ_INT64(INT64_MIN, lept_get_int64(&v));
+    lept_free(&v);
+}
+
 static void test_access_string() {
     lept_value v;
     lept_init(&v);
@@ -549,6 +1708,52 @@ static void test_access_string() {
     lept_free(&v);
 }
 
+/* Short strings are kept in the value, which must not show */
+static void test_access_string_lengths() {
+    static const char s[] = "0123456789\0abcdefghijklmnopqrstuvwxyz0123456789";
+    char json[64];
+    lept_value v, w, a;
+    size_t len, n;
+    char* out;
+#ifdef LEPT_COMPACT
+    EXPECT_TRUE(sizeof(lept_value) <= 16);
+#endif
+    lept_init(&a);
+    lept_set_array(&a, 0);
+    for (len = 0; len < sizeof(s); len++) {
+        lept_init(&v);
+        lept_set_string(&v, s, len);
+        EXPECT_EQ_SIZE_T(len, lept_get_string_length(&v));
+        EXPECT_TRUE(memcmp(s, lept_get_string(&v), len) == 0 && lept_get_string(&v)[len] == '\0');
+        lept_init(&w);
+        lept_copy(&w, &v);
+        EXPECT_TRUE(lept_is_equal(&v, &w));
+        lept_set_string(&w, s, len > 0 ? len - 1 : 1);
+        EXPECT_FALSE(lept_is_equal(&v, &w));
+        lept_move(lept_pushback_array_element(&a), &v);
+        lept_free(&w);
+    }
+    for (len = 0; len < sizeof(s); len++)
+        if (len <= 10) {
+            out = lept_stringify(lept_get_array_element(&a, len), &n);
+            json[0] = '"';
+            memcpy(json + 1, s, len);
+            json[len + 1] = '"';
+            EXPECT_TRUE(n == len + 2 && memcmp(json, out, n) == 0);
+            free(out);
+        }
+    lept_init(&v);
+    lept_copy(&v, &a);
+    EXPECT_TRUE(lept_is_equal(&v, &a));
+    lept_free(&v);
+    lept_free(&a);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, "[\"ok\",\"\\u0000\",\"a string too long to be kept in a value\"]"));
+    EXPECT_EQ_STRING("ok", lept_get_string(lept_get_array_element(&v, 0)), lept_get_string_length(lept_get_array_element(&v, 0)));
+    EXPECT_EQ_SIZE_T(1, lept_get_string_length(lept_get_array_element(&v, 1)));
+    EXPECT_EQ_STRING("a string too long to be kept in a value", lept_get_string(lept_get_array_element(&v, 2)), 39);
+    lept_free(&v);
+}
+
 static void test_access_array() {
     lept_value a, e;
     size_t i, j;
@@ -698,13 +1903,70 @@ static void test_access_object() {
 #endif
 }
 
+static void test_access_object_index() {
+    lept_value o, v;
+    lept_document d;
+    char key[16], json[16 * 100 + 16];
+    size_t i, n;
+
+    lept_init(&o);
+    lept_set_object(&o, 0);
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "k%d", (int)i);
+        lept_set_int64(lept_set_object_value(&o, key, strlen(key)), (int64_t)i);
+        EXPECT_EQ_SIZE_T(i, lept_find_object_index(&o, key, strlen(key)));
+    }
+    EXPECT_EQ_SIZE_T(1000, lept_get_object_size(&o));
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "k%d", (int)i);
+        EXPECT_EQ_SIZE_T(i, lept_find_object_index(&o, key, strlen(key)));
+        EXPECT_TRUE(strcmp(key, lept_get_object_key(&o, i)) == 0);
+    }
+    EXPECT_EQ_SIZE_T(LEPT_KEY_NOT_EXIST, lept_find_object_index(&o, "k1000", 5));
+    EXPECT_EQ_SIZE_T(LEPT_KEY_NOT_EXIST, lept_find_object_index(&o, "", 0));
+    lept_set_int64(lept_set_object_value(&o, "k7", 2), 70);
+    EXPECT_EQ_SIZE_T(1000, lept_get_object_size(&o));
+    EXPECT_EQ_INT64(70, lept_get_int64(lept_find_object_value(&o, "k7", 2)));
+    lept_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(999, lept_find_object_index(&o, "k999", 4));
+    lept_init(&v);
+    lept_copy(&v, &o);
+    EXPECT_TRUE(lept_is_equal(&v, &o));
+    EXPECT_EQ_SIZE_T(500, lept_find_object_index(&v, "k500", 4));
+    lept_free(&v);
+    lept_free(&o);
+
+    /* the first of duplicate keys is found, as by a scan */
+    n = sprintf(json, "{");
+    for (i = 0; i < 100; i++)
+        n += sprintf(json + n, "%s\"d%d\":%d", i > 0 ? "," : "", (int)(i % 50), (int)i);
+    sprintf(json + n, "}");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&o, json));
+    for (i = 0; i < 50; i++) {
+        sprintf(key, "d%d", (int)i);
+        EXPECT_EQ_SIZE_T(i, lept_find_object_index(&o, key, strlen(key)));
+    }
+    lept_free(&o);
+
+    lept_document_init(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_document_parse(&d, NULL, json, n + 1));
+    EXPECT_EQ_SIZE_T(49, lept_find_object_index(&d.root, "d49", 3));
+    lept_set_null(lept_document_set_object_value(&d, &d.root, "new", 3));
+    EXPECT_EQ_SIZE_T(100, lept_find_object_index(&d.root, "new", 3));
+    EXPECT_EQ_SIZE_T(49, lept_find_object_index(&d.root, "d49", 3));
+    lept_document_free(&d);
+}
+
 static void test_access() {
     test_access_null();
     test_access_boolean();
     test_access_number();
+    test_access_int64();
     test_access_string();
+    test_access_string_lengths();
     test_access_array();
     test_access_object();
+    test_access_object_index();
 }
 
 int main() {
@@ -715,8 +1977,17 @@ int main() {
     test_stringify();
     test_equal();
     test_copy();
+    test_copy_deep();
     test_move();
     test_swap();
+    test_parser();
+    test_document();
+    test_document_intern();
+    test_document_lazy();
+    test_tape();
+    test_document_parallel();
+    test_document_file();
+    test_allocator();
     test_access();
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
     return main_ret;